@@ -0,0 +1,112 @@
+/*
+ * async_io.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "async_io.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/aio_abi.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Create a context for up to max_ops ops in
+// flight.
+//
+bool
+async_io_setup(uint32_t max_ops, aio_context_t* p_ctx)
+{
+	*p_ctx = 0;
+
+	if (syscall(SYS_io_setup, max_ops, p_ctx) != 0) {
+		fprintf(stdout, "ERROR: io_setup %u: %d '%s'\n", max_ops, errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Destroy a context - caller must have reaped all
+// its ops.
+//
+void
+async_io_destroy(aio_context_t ctx)
+{
+	syscall(SYS_io_destroy, ctx);
+}
+
+//------------------------------------------------
+// Submit ops. Returns how many were submitted,
+// which may be fewer than n_ops, or -1 on error
+// with nothing submitted.
+//
+int
+async_io_submit(aio_context_t ctx, uint32_t n_ops, struct iocb** cbs)
+{
+	int rv;
+
+	do {
+		rv = (int)syscall(SYS_io_submit, ctx, (long)n_ops, cbs);
+	} while (rv < 0 && errno == EINTR);
+
+	return rv;
+}
+
+//------------------------------------------------
+// Wait for at least min_ops ops to complete, or
+// until timeout if not NULL, and get up to max_ops
+// of them. Returns how many completed, or -1 on
+// error.
+//
+int
+async_io_reap(aio_context_t ctx, uint32_t min_ops, uint32_t max_ops,
+		struct io_event* events, const struct timespec* timeout)
+{
+	int rv;
+
+	do {
+		rv = (int)syscall(SYS_io_getevents, ctx, (long)min_ops,
+				(long)max_ops, events, timeout);
+	} while (rv < 0 && errno == EINTR);
+
+	return rv;
+}
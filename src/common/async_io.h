@@ -0,0 +1,65 @@
+/*
+ * async_io.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <linux/aio_abi.h>
+#include <sys/types.h>
+
+
+//==========================================================
+// Public API.
+//
+
+// Thin wrappers around the kernel's native AIO syscalls - no libaio needed.
+// Only really asynchronous for O_DIRECT fds.
+
+static inline void
+async_io_prep(struct iocb* cb, int fd, bool is_write, void* buf, size_t size,
+		off_t offset)
+{
+	memset(cb, 0, sizeof(struct iocb));
+
+	cb->aio_fildes = (uint32_t)fd;
+	cb->aio_lio_opcode = is_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	cb->aio_buf = (uint64_t)(uintptr_t)buf;
+	cb->aio_nbytes = size;
+	cb->aio_offset = offset;
+}
+
+bool async_io_setup(uint32_t max_ops, aio_context_t* p_ctx);
+void async_io_destroy(aio_context_t ctx);
+int async_io_submit(aio_context_t ctx, uint32_t n_ops, struct iocb** cbs);
+int async_io_reap(aio_context_t ctx, uint32_t min_ops, uint32_t max_ops,
+		struct io_event* events, const struct timespec* timeout);
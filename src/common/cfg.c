@@ -35,11 +35,23 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "ioprio.h"
+
 
 //==========================================================
 // Typedefs & constants.
 //
 
+// Indexed by overload_mode.
+const char* const OVERLOAD_MODES[] = {
+	"stop", // default
+	"shed",
+	"throttle"
+};
+
+static const uint32_t N_OVERLOAD_MODES =
+		(uint32_t)(sizeof(OVERLOAD_MODES) / sizeof(const char*));
+
 static const char* const SCHEDULER_MODES[] = {
 	"noop", // default
 	"cfq"
@@ -79,6 +91,95 @@ parse_device_names(size_t max_num_devices, char names[][MAX_DEVICE_NAME_SIZE],
 	}
 }
 
+void
+parse_double_list(size_t max_num_values, double values[],
+		uint32_t* p_num_values)
+{
+	const char* val;
+
+	while ((val = strtok(NULL, ",;" WHITE_SPACE)) != NULL) {
+		if (*p_num_values == max_num_values) {
+			fprintf(stdout, "ERROR: too many values in list\n");
+			*p_num_values = 0;
+			return;
+		}
+
+		char* end;
+		double d_val = strtod(val, &end);
+
+		if (*end != '\0' || d_val <= 0.0) {
+			fprintf(stdout, "ERROR: bad list value '%s'\n", val);
+			*p_num_values = 0;
+			return;
+		}
+
+		values[*p_num_values] = d_val;
+		(*p_num_values)++;
+	}
+}
+
+int
+parse_ioprio()
+{
+	const char* val = strtok(NULL, ",;" WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing IO priority - using 'none'\n");
+		return 0;
+	}
+
+	uint32_t c;
+
+	for (c = 0; c < N_IOPRIO_CLASSES; c++) {
+		if (strcmp(val, IOPRIO_CLASS_NAMES[c]) == 0) {
+			break;
+		}
+	}
+
+	if (c == N_IOPRIO_CLASSES) {
+		fprintf(stdout, "ERROR: unknown IO priority '%s' - using 'none'\n",
+				val);
+		return 0;
+	}
+
+	if (c != IOPRIO_CLASS_RT && c != IOPRIO_CLASS_BE) {
+		return IOPRIO_VALUE(c, 0);
+	}
+
+	const char* level_val = strtok(NULL, ",;" WHITE_SPACE);
+	uint32_t level = level_val ?
+			(uint32_t)strtoul(level_val, NULL, 10) : IOPRIO_DEFAULT_LEVEL;
+
+	if (level >= IOPRIO_NUM_LEVELS) {
+		fprintf(stdout, "ERROR: IO priority level %u out of range - using %d\n",
+				level, IOPRIO_DEFAULT_LEVEL);
+		level = IOPRIO_DEFAULT_LEVEL;
+	}
+
+	return IOPRIO_VALUE(c, level);
+}
+
+overload_mode
+parse_overload_mode()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing overload mode - using 'stop'\n");
+		return OVERLOAD_STOP;
+	}
+
+	for (uint32_t m = 0; m < N_OVERLOAD_MODES; m++) {
+		if (strcmp(val, OVERLOAD_MODES[m]) == 0) {
+			return (overload_mode)m;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown overload mode '%s' - using 'stop'\n", val);
+
+	return OVERLOAD_STOP;
+}
+
 const char*
 parse_scheduler_mode()
 {
@@ -120,6 +221,33 @@ parse_uint32()
 	return (uint32_t)u64_val;
 }
 
+void
+parse_uint32_list(size_t max_num_values, uint32_t values[],
+		uint32_t* p_num_values)
+{
+	const char* val;
+
+	while ((val = strtok(NULL, ",;" WHITE_SPACE)) != NULL) {
+		if (*p_num_values == max_num_values) {
+			fprintf(stdout, "ERROR: too many values in list\n");
+			*p_num_values = 0;
+			return;
+		}
+
+		char* end;
+		uint64_t u64_val = strtoul(val, &end, 10);
+
+		if (*end != '\0' || u64_val > UINT32_MAX) {
+			fprintf(stdout, "ERROR: bad list value '%s'\n", val);
+			*p_num_values = 0;
+			return;
+		}
+
+		values[*p_num_values] = (uint32_t)u64_val;
+		(*p_num_values)++;
+	}
+}
+
 bool
 parse_yes_no()
 {
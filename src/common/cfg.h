@@ -41,6 +41,15 @@
 #define WHITE_SPACE " \t\n\r"
 #define MAX_DEVICE_NAME_SIZE 64
 
+// What to do when max-reqs-queued or max-lag-sec is exceeded.
+typedef enum {
+	OVERLOAD_STOP,      // stop the test (default)
+	OVERLOAD_SHED,      // drop and count what can't be done on time
+	OVERLOAD_THROTTLE   // shed, and back off the offered load
+} overload_mode;
+
+extern const char* const OVERLOAD_MODES[];
+
 
 //==========================================================
 // Public API.
@@ -48,8 +57,14 @@
 
 void parse_device_names(size_t max_num_devices,
 		char names[][MAX_DEVICE_NAME_SIZE], uint32_t* p_num_devices);
+void parse_double_list(size_t max_num_values, double values[],
+		uint32_t* p_num_values);
+int parse_ioprio();
+overload_mode parse_overload_mode();
 const char* parse_scheduler_mode();
 uint32_t parse_uint32();
+void parse_uint32_list(size_t max_num_values, uint32_t values[],
+		uint32_t* p_num_values);
 bool parse_yes_no();
 
 static inline void
@@ -0,0 +1,166 @@
+/*
+ * coroutine.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "coroutine.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+struct coroutine_s {
+	ucontext_t ctx;
+	ucontext_t caller_ctx;
+	coroutine_fn fn;
+	void* udata;
+	bool done;
+	uint8_t* stack;
+};
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread coroutine* tl_running;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void run_coroutine();
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Create a coroutine which will call fn(udata)
+// when first resumed.
+//
+coroutine*
+coroutine_create(uint32_t stack_size, coroutine_fn fn, void* udata)
+{
+	coroutine* co = malloc(sizeof(coroutine));
+
+	if (! co) {
+		fprintf(stdout, "ERROR: creating coroutine (malloc)\n");
+		return NULL;
+	}
+
+	if (! (co->stack = malloc(stack_size))) {
+		fprintf(stdout, "ERROR: creating coroutine stack (malloc)\n");
+		free(co);
+		return NULL;
+	}
+
+	getcontext(&co->ctx);
+
+	co->ctx.uc_stack.ss_sp = co->stack;
+	co->ctx.uc_stack.ss_size = stack_size;
+	co->ctx.uc_link = &co->caller_ctx;
+
+	makecontext(&co->ctx, run_coroutine, 0);
+
+	co->fn = fn;
+	co->udata = udata;
+	co->done = false;
+
+	return co;
+}
+
+//------------------------------------------------
+// Free a coroutine - it must not be running, but
+// needn't have finished.
+//
+void
+coroutine_destroy(coroutine* co)
+{
+	free(co->stack);
+	free(co);
+}
+
+//------------------------------------------------
+// Run a coroutine until it yields or finishes.
+// Returns false if it has finished.
+//
+bool
+coroutine_resume(coroutine* co)
+{
+	if (co->done) {
+		return false;
+	}
+
+	coroutine* resumer = tl_running;
+
+	tl_running = co;
+	swapcontext(&co->caller_ctx, &co->ctx);
+	tl_running = resumer;
+
+	return ! co->done;
+}
+
+//------------------------------------------------
+// Switch from the running coroutine back to
+// whatever resumed it.
+//
+void
+coroutine_yield()
+{
+	coroutine* co = tl_running;
+
+	swapcontext(&co->ctx, &co->caller_ctx);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Entry point of every coroutine - makecontext()
+// can't portably pass a pointer.
+//
+static void
+run_coroutine()
+{
+	coroutine* co = tl_running;
+
+	co->fn(co->udata);
+	co->done = true;
+
+	// Returning switches to uc_link, i.e. the resumer.
+}
@@ -0,0 +1,163 @@
+/*
+ * cpu_time.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "cpu_time.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "atomic.h"
+#include "trace.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint64_t group_cpu_ns(cpu_group* g);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Add a thread to a group - call from the thread
+// that created it. Returns false if the group is
+// full or the thread's CPU clock isn't available.
+//
+bool
+cpu_group_add(cpu_group* g, pthread_t tid)
+{
+	if (g->n_threads == g->max_threads) {
+		fprintf(stdout, "ERROR: too many threads in cpu group %s\n", g->name);
+		return false;
+	}
+
+	int err = pthread_getcpuclockid(tid, &g->clock_ids[g->n_threads]);
+
+	if (err != 0) {
+		fprintf(stdout, "ERROR: thread cpu clock for %s: %d '%s'\n", g->name,
+				err, act_strerror(err));
+		return false;
+	}
+
+	g->n_threads++;
+
+	return true;
+}
+
+//------------------------------------------------
+// Create a CPU accounting group. There's no
+// destroy(), but you can just free the group.
+//
+cpu_group*
+cpu_group_create(const char* name, uint32_t max_threads)
+{
+	cpu_group* g = malloc(sizeof(cpu_group) + (max_threads * sizeof(clockid_t)));
+
+	if (! g) {
+		fprintf(stdout, "ERROR: creating cpu group (malloc)\n");
+		return NULL;
+	}
+
+	memset((void*)g, 0, sizeof(cpu_group));
+
+	g->name = name;
+	g->max_threads = max_threads;
+
+	return g;
+}
+
+//------------------------------------------------
+// Report the group's CPU time since the last call,
+// and its CPU cost per op and per MB.
+//
+void
+cpu_group_report(cpu_group* g)
+{
+	uint64_t now_ns = group_cpu_ns(g);
+	uint64_t n_ops = atomic64_get(g->n_ops);
+	uint64_t n_bytes = atomic64_get(g->n_bytes);
+
+	uint64_t cpu_us = (now_ns - g->last_ns) / 1000;
+	uint64_t ops = n_ops - g->last_ops;
+	uint64_t bytes = n_bytes - g->last_bytes;
+
+	g->last_ns = now_ns;
+	g->last_ops = n_ops;
+	g->last_bytes = n_bytes;
+
+	if (ops == 0) {
+		fprintf(stdout, "cpu-%s: %" PRIu64 " us\n", g->name, cpu_us);
+		return;
+	}
+
+	if (bytes == 0) {
+		fprintf(stdout, "cpu-%s: %" PRIu64 " us, %.2lf us/op\n", g->name,
+				cpu_us, (double)cpu_us / ops);
+		return;
+	}
+
+	fprintf(stdout, "cpu-%s: %" PRIu64 " us, %.2lf us/op, %.2lf us/MB\n",
+			g->name, cpu_us, (double)cpu_us / ops,
+			(double)cpu_us * (1024 * 1024) / bytes);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Total CPU time used so far by the group's
+// threads. Skips threads whose clock can't be read
+// (e.g. they exited) - never goes backwards.
+//
+static uint64_t
+group_cpu_ns(cpu_group* g)
+{
+	uint64_t total_ns = 0;
+
+	for (uint32_t i = 0; i < g->n_threads; i++) {
+		struct timespec ts;
+
+		if (clock_gettime(g->clock_ids[i], &ts) == 0) {
+			total_ns += ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+		}
+	}
+
+	return total_ns > g->last_ns ? total_ns : g->last_ns;
+}
@@ -0,0 +1,71 @@
+/*
+ * cpu_time.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "atomic.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// CPU time used by a group of threads, and the work they did, so we can
+// report CPU cost per op and per MB.
+typedef struct cpu_group_s {
+	const char* name;
+	atomic64 n_ops;
+	atomic64 n_bytes;
+	uint64_t last_ns;
+	uint64_t last_ops;
+	uint64_t last_bytes;
+	uint32_t max_threads;
+	uint32_t n_threads;
+	clockid_t clock_ids[];
+} cpu_group;
+
+
+//==========================================================
+// Public API.
+//
+
+bool cpu_group_add(cpu_group* g, pthread_t tid);
+cpu_group* cpu_group_create(const char* name, uint32_t max_threads);
+void cpu_group_report(cpu_group* g);
+
+static inline void
+cpu_group_count(cpu_group* g, uint64_t n_ops, uint64_t n_bytes)
+{
+	atomic64_add(&g->n_ops, (int64_t)n_ops);
+	atomic64_add(&g->n_bytes, (int64_t)n_bytes);
+}
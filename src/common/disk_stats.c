@@ -0,0 +1,180 @@
+/*
+ * disk_stats.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "disk_stats.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "clock.h"
+#include "trace.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define SECTOR_SIZE 512 // stat file units, regardless of device
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool sample(disk_stats* ds, uint64_t fields[]);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Find the block device stats for a device (or a
+// file's underlying device) and take a baseline
+// sample. Returns false if there are no stats -
+// we then just don't report them.
+//
+bool
+disk_stats_init(const char* device_name, disk_stats* ds)
+{
+	memset(ds, 0, sizeof(disk_stats));
+
+	struct stat st;
+
+	if (stat(device_name, &st) != 0) {
+		fprintf(stdout, "ERROR: stat %s: %d '%s'\n", device_name, errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+
+	snprintf(ds->path, sizeof(ds->path), "/sys/dev/block/%u:%u/stat",
+			major(dev), minor(dev));
+
+	ds->ok = sample(ds, ds->fields);
+
+	if (! ds->ok) {
+		fprintf(stdout, "no kernel disk stats for %s\n", device_name);
+	}
+
+	return ds->ok;
+}
+
+//------------------------------------------------
+// Sample the kernel's stats, and report rates and
+// averages since the last sample.
+//
+void
+disk_stats_report(const char* device_name, disk_stats* ds)
+{
+	if (! ds->ok) {
+		return;
+	}
+
+	uint64_t last_us = ds->sample_us;
+	uint64_t f[N_DISK_STATS_FIELDS];
+
+	if (! sample(ds, f)) {
+		return;
+	}
+
+	double interval_sec = (double)(ds->sample_us - last_us) / 1000000.0;
+
+	if (interval_sec <= 0.0) {
+		return;
+	}
+
+	uint64_t d[N_DISK_STATS_FIELDS];
+
+	for (int i = 0; i < N_DISK_STATS_FIELDS; i++) {
+		d[i] = f[i] - ds->fields[i];
+		ds->fields[i] = f[i];
+	}
+
+	uint64_t ios = d[DS_READ_IOS] + d[DS_WRITE_IOS];
+	double await_ms = ios == 0 ? 0.0 :
+			(double)(d[DS_READ_TICKS] + d[DS_WRITE_TICKS]) / ios;
+
+	fprintf(stdout, "disk-stats %s: reads/s %.1lf writes/s %.1lf "
+			"read-MB/s %.2lf write-MB/s %.2lf "
+			"read-merges/s %.1lf write-merges/s %.1lf "
+			"in-flight %" PRIu64 " util-pct %.1lf await-ms %.3lf "
+			"queue-depth %.2lf\n",
+			device_name,
+			d[DS_READ_IOS] / interval_sec,
+			d[DS_WRITE_IOS] / interval_sec,
+			(double)(d[DS_READ_SECTORS] * SECTOR_SIZE) / interval_sec /
+					(1024 * 1024),
+			(double)(d[DS_WRITE_SECTORS] * SECTOR_SIZE) / interval_sec /
+					(1024 * 1024),
+			d[DS_READ_MERGES] / interval_sec,
+			d[DS_WRITE_MERGES] / interval_sec,
+			f[DS_IN_FLIGHT],
+			(double)d[DS_IO_TICKS] / (interval_sec * 10.0), // ms -> %
+			await_ms,
+			(double)d[DS_TIME_IN_QUEUE] / (interval_sec * 1000.0));
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+sample(disk_stats* ds, uint64_t fields[])
+{
+	FILE* fh = fopen(ds->path, "r");
+
+	if (! fh) {
+		return false;
+	}
+
+	int n = fscanf(fh, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+			" %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+			" %" SCNu64 " %" SCNu64 " %" SCNu64,
+			&fields[0], &fields[1], &fields[2], &fields[3],
+			&fields[4], &fields[5], &fields[6], &fields[7],
+			&fields[8], &fields[9], &fields[10]);
+
+	fclose(fh);
+
+	if (n != N_DISK_STATS_FIELDS) {
+		return false;
+	}
+
+	ds->sample_us = get_us();
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * disk_stats.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Fields of /sys/dev/block/<major>:<minor>/stat (and /proc/diskstats) that
+// we use, in order - see the kernel's Documentation/block/stat.
+typedef enum {
+	DS_READ_IOS,
+	DS_READ_MERGES,
+	DS_READ_SECTORS,
+	DS_READ_TICKS,          // ms
+	DS_WRITE_IOS,
+	DS_WRITE_MERGES,
+	DS_WRITE_SECTORS,
+	DS_WRITE_TICKS,         // ms
+	DS_IN_FLIGHT,
+	DS_IO_TICKS,            // ms
+	DS_TIME_IN_QUEUE,       // ms, weighted by number in flight
+
+	N_DISK_STATS_FIELDS
+} disk_stats_field;
+
+// The kernel's stats for the block device holding a device or file, as of
+// the last sample.
+typedef struct disk_stats_s {
+	char path[64];
+	bool ok;
+	uint64_t sample_us;
+	uint64_t fields[N_DISK_STATS_FIELDS];
+} disk_stats;
+
+
+//==========================================================
+// Public API.
+//
+
+bool disk_stats_init(const char* device_name, disk_stats* ds);
+void disk_stats_report(const char* device_name, disk_stats* ds);
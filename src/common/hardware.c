@@ -60,6 +60,7 @@ typedef enum {
 
 static file_res read_list(const char* path, cpu_set_t* mask);
 static file_res read_index(const char* path, uint16_t* val);
+static file_res read_numa_node(const char* path, int32_t* node);
 static file_res read_file(const char* path, void* buf, size_t* limit);
 
 
@@ -67,6 +68,47 @@ static file_res read_file(const char* path, void* buf, size_t* limit);
 // Public API.
 //
 
+//------------------------------------------------
+// Get the CPUs local to a device's NUMA node.
+// Returns false if the device has no known node.
+//
+bool
+device_numa_cpus(const char* device_name, cpu_set_t* mask)
+{
+	const char* last_slash = strrchr(device_name, '/');
+	const char* device_tag = last_slash ? last_slash + 1 : device_name;
+
+	// Whole disks, then partitions, then NVMe namespaces.
+	static const char* const NODE_PATHS[] = {
+			"/sys/class/block/%s/device/numa_node",
+			"/sys/class/block/%s/../device/numa_node",
+			"/sys/class/block/%s/device/device/numa_node"
+	};
+
+	int32_t node = -1;
+
+	for (uint32_t i = 0; i < sizeof(NODE_PATHS) / sizeof(const char*); i++) {
+		char path[1000];
+
+		snprintf(path, sizeof(path), NODE_PATHS[i], device_tag);
+
+		if (read_numa_node(path, &node) == FILE_RES_OK) {
+			break;
+		}
+	}
+
+	if (node < 0) {
+		return false; // not found, or single-node host (reported as -1)
+	}
+
+	char path[1000];
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+			node);
+
+	return read_list(path, mask) == FILE_RES_OK && CPU_COUNT(mask) != 0;
+}
+
 uint32_t
 num_cpus()
 {
@@ -230,6 +272,32 @@ read_index(const char* path, uint16_t* val)
 	return FILE_RES_OK;
 }
 
+static file_res
+read_numa_node(const char* path, int32_t* node)
+{
+	char buf[100];
+	size_t limit = sizeof(buf);
+	file_res res = read_file(path, buf, &limit);
+
+	if (res != FILE_RES_OK) {
+		return res;
+	}
+
+	buf[limit - 1] = '\0';
+
+	char* end;
+	int64_t x = strtol(buf, &end, 10);
+
+	if (end == buf || x >= CPU_SETSIZE) {
+		fprintf(stdout, "ERROR: invalid NUMA node '%s' in %s\n", buf, path);
+		return FILE_RES_ERROR;
+	}
+
+	*node = (int32_t)x;
+
+	return FILE_RES_OK;
+}
+
 static file_res
 read_file(const char* path, void* buf, size_t* limit)
 {
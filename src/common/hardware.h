@@ -28,6 +28,8 @@
 // Includes.
 //
 
+#include <sched.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 
@@ -35,5 +37,6 @@
 // Public API.
 //
 
+bool device_numa_cpus(const char* device_name, cpu_set_t* mask);
 uint32_t num_cpus();
 void set_scheduler(const char* device_name, const char* mode);
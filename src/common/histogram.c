@@ -184,6 +184,33 @@ histogram_dump(histogram* h, const char* tag)
 	}
 }
 
+//------------------------------------------------
+// Copy the current bucket counts - caller passes
+// an array of N_BUCKETS.
+//
+void
+histogram_get_counts(histogram* h, uint64_t counts[])
+{
+	for (int b = 0; b < N_BUCKETS; b++) {
+		counts[b] = atomic64_get(h->counts[b]);
+	}
+}
+
+//------------------------------------------------
+// Get the current total count over all buckets.
+//
+uint64_t
+histogram_get_total(histogram* h)
+{
+	uint64_t total_count = 0;
+
+	for (int b = 0; b < N_BUCKETS; b++) {
+		total_count += atomic64_get(h->counts[b]);
+	}
+
+	return total_count;
+}
+
 //------------------------------------------------
 // Insert a time interval data point. The interval
 // is specified in nanoseconds, and converted to
@@ -224,6 +251,41 @@ histogram_insert_data_point(histogram* h, uint64_t delta_ns)
 }
 
 
+//------------------------------------------------
+// Get the latency (in the histogram's units) that
+// pct percent of the counts are within, as the
+// upper bound of the bucket containing the pct'th
+// percentile - e.g. 4 means "within 4 ms (or us)".
+// Returns 0 if there are no counts.
+//
+uint64_t
+histogram_percentile(const uint64_t counts[], double pct)
+{
+	uint64_t total_count = 0;
+
+	for (int b = 0; b < N_BUCKETS; b++) {
+		total_count += counts[b];
+	}
+
+	if (total_count == 0) {
+		return 0;
+	}
+
+	double threshold = (double)total_count * pct / 100.0;
+	uint64_t running_count = 0;
+
+	for (int b = 0; b < N_BUCKETS - 1; b++) {
+		running_count += counts[b];
+
+		if ((double)running_count >= threshold) {
+			return 1ULL << b;
+		}
+	}
+
+	return UINT64_MAX;
+}
+
+
 //==========================================================
 // Local helpers.
 //
@@ -57,4 +57,7 @@ typedef struct histogram_s {
 
 histogram* histogram_create(histogram_scale scale);
 void histogram_dump(histogram* h, const char* tag);
+void histogram_get_counts(histogram* h, uint64_t counts[]);
+uint64_t histogram_get_total(histogram* h);
 void histogram_insert_data_point(histogram* h, uint64_t delta_ns);
+uint64_t histogram_percentile(const uint64_t counts[], double pct);
@@ -0,0 +1,95 @@
+/*
+ * ioprio.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "ioprio.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define IOPRIO_WHO_PROCESS 1 // with who 0, means the calling thread
+
+// Indexed by ioprio_class.
+const char* const IOPRIO_CLASS_NAMES[] = {
+	"none", // default
+	"rt",
+	"be",
+	"idle"
+};
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Format an IO priority as it's configured.
+//
+void
+ioprio_name(int ioprio, char name[IOPRIO_NAME_SIZE])
+{
+	ioprio_class c = IOPRIO_CLASS_OF(ioprio);
+
+	if (c == IOPRIO_CLASS_RT || c == IOPRIO_CLASS_BE) {
+		snprintf(name, IOPRIO_NAME_SIZE, "%s,%d", IOPRIO_CLASS_NAMES[c],
+				IOPRIO_LEVEL_OF(ioprio));
+	}
+	else {
+		snprintf(name, IOPRIO_NAME_SIZE, "%s", IOPRIO_CLASS_NAMES[c]);
+	}
+}
+
+//------------------------------------------------
+// Set the calling thread's IO priority. Class none
+// means back to the default. The rt class needs
+// CAP_SYS_ADMIN.
+//
+bool
+ioprio_set_self(int ioprio)
+{
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0) {
+		char name[IOPRIO_NAME_SIZE];
+
+		ioprio_name(ioprio, name);
+		fprintf(stdout, "ERROR: ioprio_set %s: %d '%s'\n", name, errno,
+				act_strerror(errno));
+		return false;
+	}
+
+	return true;
+}
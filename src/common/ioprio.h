@@ -0,0 +1,67 @@
+/*
+ * ioprio.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// IO scheduling classes, as in the kernel's include/uapi/linux/ioprio.h.
+typedef enum {
+	IOPRIO_CLASS_NONE,  // inherit - best effort, level from nice value
+	IOPRIO_CLASS_RT,
+	IOPRIO_CLASS_BE,
+	IOPRIO_CLASS_IDLE,
+
+	N_IOPRIO_CLASSES
+} ioprio_class;
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_NUM_LEVELS 8 // for rt and be - 0 is highest priority
+#define IOPRIO_DEFAULT_LEVEL 4
+
+#define IOPRIO_VALUE(c, l) (((c) << IOPRIO_CLASS_SHIFT) | (l))
+#define IOPRIO_CLASS_OF(v) ((ioprio_class)((v) >> IOPRIO_CLASS_SHIFT))
+#define IOPRIO_LEVEL_OF(v) ((v) & ((1 << IOPRIO_CLASS_SHIFT) - 1))
+
+#define IOPRIO_NAME_SIZE 8 // e.g. "be,4" or "idle"
+
+extern const char* const IOPRIO_CLASS_NAMES[];
+
+
+//==========================================================
+// Public API.
+//
+
+void ioprio_name(int ioprio, char name[IOPRIO_NAME_SIZE]);
+bool ioprio_set_self(int ioprio);
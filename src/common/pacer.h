@@ -0,0 +1,143 @@
+/*
+ * pacer.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "clock.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Schedules operations at a rate that scales with a load factor - if the
+// factor changes, the schedule restarts from "now" at the new rate.
+typedef struct pacer_s {
+	double ops_per_sec;         // at load factor 1.0
+	double factor;              // load factor the schedule is based on
+	uint64_t start_us;          // run start
+	uint64_t base_us;           // schedule start, relative to run start
+	uint64_t base_count;        // ops done before schedule start
+	uint64_t count;             // ops done since run start
+} pacer;
+
+
+//==========================================================
+// Public API.
+//
+
+// When the last counted op was due, relative to run start.
+static inline uint64_t
+pacer_target_us(const pacer* p)
+{
+	return p->base_us + (uint64_t)
+			((double)((p->count - p->base_count) * 1000000) /
+					(p->ops_per_sec * p->factor));
+}
+
+static inline void
+pacer_init(pacer* p, uint64_t start_us, double ops_per_sec, double factor)
+{
+	p->ops_per_sec = ops_per_sec;
+	p->factor = factor;
+	p->start_us = start_us;
+	p->base_us = 0;
+	p->base_count = 0;
+	p->count = 0;
+}
+
+// How late the next op is, i.e. how long ago it was due - 0 if it's not yet
+// due.
+static inline uint64_t
+pacer_lag_us(const pacer* p)
+{
+	uint64_t now_us = get_us() - p->start_us;
+	uint64_t target_us = pacer_target_us(p);
+
+	return now_us > target_us ? now_us - target_us : 0;
+}
+
+// Count n_ops ops and return how long to sleep until the next op is due -
+// negative if we're behind schedule.
+static inline int64_t
+pacer_next_sleep_us(pacer* p, uint64_t n_ops, double factor)
+{
+	p->count += n_ops;
+
+	uint64_t now_us = get_us() - p->start_us;
+
+	if (factor != p->factor) {
+		p->factor = factor;
+		p->base_us = now_us;
+		p->base_count = p->count;
+	}
+
+	return (int64_t)(pacer_target_us(p) - now_us);
+}
+
+// Claim the next op for a pacer shared by several threads - caller must
+// serialize calls. Returns how long to sleep until the claimed op is due -
+// negative if it's already late.
+static inline int64_t
+pacer_claim_sleep_us(pacer* p, double factor)
+{
+	uint64_t now_us = get_us() - p->start_us;
+
+	if (factor != p->factor) {
+		p->factor = factor;
+		p->base_us = now_us;
+		p->base_count = p->count;
+	}
+
+	int64_t sleep_us = (int64_t)(pacer_target_us(p) - now_us);
+
+	p->count++;
+
+	return sleep_us;
+}
+
+// Give up on catching up - restart the schedule from "now". Returns the
+// number of ops we were behind by.
+static inline uint64_t
+pacer_skip(pacer* p)
+{
+	uint64_t now_us = get_us() - p->start_us;
+	uint64_t target_us = pacer_target_us(p);
+
+	p->base_us = now_us;
+	p->base_count = p->count;
+
+	if (target_us >= now_us) {
+		return 0;
+	}
+
+	return (uint64_t)((double)(now_us - target_us) * p->ops_per_sec *
+			p->factor / 1000000.0);
+}
@@ -0,0 +1,277 @@
+/*
+ * perf.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "perf.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include "atomic.h"
+#include "trace.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef struct perf_event_def_s {
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+} perf_event_def;
+
+static const perf_event_def EVENTS[N_PERF_EVENTS] = {
+		{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ "context-switches", PERF_TYPE_SOFTWARE,
+				PERF_COUNT_SW_CONTEXT_SWITCHES },
+		{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+};
+
+// Layout of read() results, given the read_format we ask for.
+typedef struct perf_read_s {
+	uint64_t value;
+	uint64_t time_enabled;
+	uint64_t time_running;
+} perf_read;
+
+
+//==========================================================
+// Globals.
+//
+
+// Set by perf_probe() for counters that perf_event_paranoid (typically 2)
+// only lets us count in user space.
+static bool g_user_only[N_PERF_EVENTS] = { false };
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static int open_event(perf_event_id e);
+static bool read_event(int fd, uint64_t* p_value);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Open counters for the calling thread. Counters
+// that aren't permitted or supported are just left
+// out - see perf_probe().
+//
+void
+perf_group_add_self(perf_group* g)
+{
+	uint32_t i = (uint32_t)atomic32_incr(&g->n_threads) - 1;
+
+	if (i >= g->max_threads) {
+		return;
+	}
+
+	for (int e = 0; e < N_PERF_EVENTS; e++) {
+		g->fds[i][e] = open_event((perf_event_id)e);
+	}
+}
+
+//------------------------------------------------
+// Create a counter group for up to max_threads
+// threads.
+//
+perf_group*
+perf_group_create(const char* name, uint32_t max_threads)
+{
+	size_t fds_size = max_threads * sizeof(int[N_PERF_EVENTS]);
+	perf_group* g = malloc(sizeof(perf_group) + fds_size);
+
+	if (! g) {
+		fprintf(stdout, "ERROR: creating perf group (malloc)\n");
+		return NULL;
+	}
+
+	memset((void*)g, 0, sizeof(perf_group));
+	memset((void*)g->fds, -1, fds_size);
+
+	g->name = name;
+	g->max_threads = max_threads;
+
+	return g;
+}
+
+//------------------------------------------------
+// Close the group's counters and free it.
+//
+void
+perf_group_destroy(perf_group* g)
+{
+	for (uint32_t i = 0; i < g->max_threads; i++) {
+		for (int e = 0; e < N_PERF_EVENTS; e++) {
+			if (g->fds[i][e] != -1) {
+				close(g->fds[i][e]);
+			}
+		}
+	}
+
+	free(g);
+}
+
+//------------------------------------------------
+// Report the group's counts since the last call.
+// Counts are scaled up if the kernel multiplexed
+// the counters. Unavailable counters show "n/a".
+//
+void
+perf_group_report(perf_group* g)
+{
+	fprintf(stdout, "perf-%s:", g->name);
+
+	for (int e = 0; e < N_PERF_EVENTS; e++) {
+		uint64_t total = 0;
+		bool available = false;
+
+		for (uint32_t i = 0; i < g->max_threads; i++) {
+			uint64_t value;
+
+			if (g->fds[i][e] != -1 && read_event(g->fds[i][e], &value)) {
+				total += value;
+				available = true;
+			}
+		}
+
+		if (! available) {
+			fprintf(stdout, " %s n/a", EVENTS[e].name);
+			continue;
+		}
+
+		// Scaling may make a total dip slightly - don't report that.
+		uint64_t delta = total > g->last[e] ? total - g->last[e] : 0;
+
+		g->last[e] = total > g->last[e] ? total : g->last[e];
+
+		fprintf(stdout, " %s %" PRIu64, EVENTS[e].name, delta);
+	}
+
+	fprintf(stdout, "\n");
+}
+
+//------------------------------------------------
+// Check which counters we can open, and say why
+// if we can't. Counters we aren't permitted to
+// count in the kernel fall back to user space
+// only. Must be called before any thread adds
+// itself to a group.
+//
+void
+perf_probe()
+{
+	for (int e = 0; e < N_PERF_EVENTS; e++) {
+		g_user_only[e] = false;
+
+		int fd = open_event((perf_event_id)e);
+
+		if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+			g_user_only[e] = true;
+			fd = open_event((perf_event_id)e);
+		}
+
+		if (fd == -1) {
+			fprintf(stdout, "perf counter %s not available: %d '%s'\n",
+					EVENTS[e].name, errno, act_strerror(errno));
+			continue;
+		}
+
+		fprintf(stdout, "perf counter %s counting %s\n", EVENTS[e].name,
+				g_user_only[e] ? "user space only" : "user and kernel space");
+
+		close(fd);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Open a counter for the calling thread, on any
+// CPU, excluding kernel and hypervisor if probing
+// found that necessary. Returns -1 (with errno
+// set) on failure.
+//
+static int
+open_event(perf_event_id e)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+
+	attr.size = sizeof(attr);
+	attr.type = EVENTS[e].type;
+	attr.config = EVENTS[e].config;
+	attr.read_format =
+			PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_kernel = g_user_only[e] ? 1 : 0;
+	attr.exclude_hv = g_user_only[e] ? 1 : 0;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+			PERF_FLAG_FD_CLOEXEC);
+}
+
+//------------------------------------------------
+// Read a counter, scaled up if it was only
+// running part of the time it was enabled.
+//
+static bool
+read_event(int fd, uint64_t* p_value)
+{
+	perf_read r;
+
+	if (read(fd, &r, sizeof(r)) != sizeof(r)) {
+		return false;
+	}
+
+	if (r.time_running != 0 && r.time_running < r.time_enabled) {
+		r.value = (uint64_t)
+				((double)r.value * r.time_enabled / r.time_running);
+	}
+
+	*p_value = r.value;
+
+	return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * perf.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "atomic.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	PERF_INSTRUCTIONS,
+	PERF_CYCLES,
+	PERF_CACHE_MISSES,
+	PERF_CONTEXT_SWITCHES,
+	PERF_PAGE_FAULTS,
+
+	N_PERF_EVENTS
+} perf_event_id;
+
+// Hardware and software counters summed over a group of threads. Threads
+// add themselves - counters are per-thread (i.e. by kernel thread id), so
+// they can't be opened for another pthread.
+typedef struct perf_group_s {
+	const char* name;
+	uint32_t max_threads;
+	atomic32 n_threads;
+	uint64_t last[N_PERF_EVENTS];
+	int fds[][N_PERF_EVENTS];
+} perf_group;
+
+
+//==========================================================
+// Public API.
+//
+
+void perf_group_add_self(perf_group* g);
+perf_group* perf_group_create(const char* name, uint32_t max_threads);
+void perf_group_destroy(perf_group* g);
+void perf_group_report(perf_group* g);
+void perf_probe();
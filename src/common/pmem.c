@@ -0,0 +1,309 @@
+/*
+ * pmem.c
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "pmem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	FLUSH_CLFLUSH,
+	FLUSH_CLFLUSHOPT,
+	FLUSH_CLWB
+} flush_insn;
+
+static const char* const FLUSH_INSN_NAMES[] = {
+		"clflush",
+		"clflushopt",
+		"clwb"
+};
+
+
+//==========================================================
+// Globals.
+//
+
+static flush_insn g_flush_insn = FLUSH_CLFLUSH;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void flush_lines(const uint8_t* p, size_t size);
+static void memcpy_nt(uint8_t* dst, const uint8_t* src, size_t size);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline void
+store_fence()
+{
+#if defined(__x86_64__)
+	_mm_sfence();
+#else
+	__sync_synchronize();
+#endif
+}
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Map a file (on a DAX filesystem, or tmpfs) for
+// loads and stores. If size is not 0 the file is
+// created or resized to it, otherwise we use the
+// file's existing size. Returns NULL on failure.
+//
+uint8_t*
+pmem_map(const char* name, uint64_t size, uint64_t* p_size)
+{
+	int fd = open(name, O_RDWR | (size == 0 ? 0 : O_CREAT), S_IRUSR | S_IWUSR);
+
+	if (fd == -1) {
+		fprintf(stdout, "ERROR: open pmem file %s errno %d '%s'\n", name,
+				errno, act_strerror(errno));
+		return NULL;
+	}
+
+	if (size != 0) {
+		if (ftruncate(fd, (off_t)size) != 0) {
+			fprintf(stdout, "ERROR: ftruncate pmem file %s errno %d '%s'\n",
+					name, errno, act_strerror(errno));
+			close(fd);
+			return NULL;
+		}
+	}
+	else {
+		struct stat st;
+
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			fprintf(stdout, "ERROR: pmem file %s has no size\n", name);
+			close(fd);
+			return NULL;
+		}
+
+		size = (uint64_t)st.st_size;
+	}
+
+	bool dax = true;
+
+	// MAP_SYNC only works on DAX - stores then need no msync() to persist.
+	void* base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED_VALIDATE | MAP_SYNC, fd, 0);
+
+	if (base == MAP_FAILED) {
+		dax = false;
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	close(fd);
+
+	if (base == MAP_FAILED) {
+		fprintf(stdout, "ERROR: mmap pmem file %s errno %d '%s'\n", name,
+				errno, act_strerror(errno));
+		return NULL;
+	}
+
+	fprintf(stdout, "%s mapped %s\n", name, dax ? "with MAP_SYNC (DAX)" :
+			"without MAP_SYNC (not DAX)");
+
+	*p_size = size;
+
+	return (uint8_t*)base;
+}
+
+//------------------------------------------------
+// Find the best cache line write back instruction
+// this CPU has.
+//
+void
+pmem_probe()
+{
+#if defined(__x86_64__)
+	uint32_t eax, ebx, ecx, edx;
+
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0) {
+		if ((ebx & (1 << 24)) != 0) {
+			g_flush_insn = FLUSH_CLWB;
+		}
+		else if ((ebx & (1 << 23)) != 0) {
+			g_flush_insn = FLUSH_CLFLUSHOPT;
+		}
+	}
+
+	fprintf(stdout, "pmem cache line flush: %s\n",
+			FLUSH_INSN_NAMES[g_flush_insn]);
+#else
+	fprintf(stdout, "pmem cache line flush: n/a, using full fences only\n");
+#endif
+}
+
+//------------------------------------------------
+// Read from mapped memory.
+//
+void
+pmem_read(void* dst, const uint8_t* src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+//------------------------------------------------
+// Unmap a file mapped by pmem_map().
+//
+void
+pmem_unmap(uint8_t* base, uint64_t size)
+{
+	munmap(base, size);
+}
+
+//------------------------------------------------
+// Write to mapped memory, persisting as directed.
+//
+void
+pmem_write(uint8_t* dst, const void* src, size_t size, pmem_persist_mode mode)
+{
+	switch (mode) {
+	case PMEM_PERSIST_NONE:
+		memcpy(dst, src, size);
+		break;
+	case PMEM_PERSIST_NT:
+		memcpy_nt(dst, (const uint8_t*)src, size);
+		store_fence();
+		break;
+	case PMEM_PERSIST_CLWB:
+		memcpy(dst, src, size);
+		flush_lines(dst, size);
+		store_fence();
+		break;
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+//------------------------------------------------
+// Write back (and maybe evict) all cache lines
+// covering a range.
+//
+static void
+flush_lines(const uint8_t* p, size_t size)
+{
+#if defined(__x86_64__)
+	const uint8_t* end = p + size;
+
+	p = (const uint8_t*)((uint64_t)p & ~(uint64_t)(PMEM_CACHE_LINE_SIZE - 1));
+
+	for ( ; p < end; p += PMEM_CACHE_LINE_SIZE) {
+		switch (g_flush_insn) {
+		case FLUSH_CLWB:
+			__asm__ volatile("clwb %0" : "+m" (*(volatile uint8_t*)p));
+			break;
+		case FLUSH_CLFLUSHOPT:
+			__asm__ volatile("clflushopt %0" : "+m" (*(volatile uint8_t*)p));
+			break;
+		case FLUSH_CLFLUSH:
+			_mm_clflush(p);
+			break;
+		}
+	}
+#else
+	(void)p;
+	(void)size;
+#endif
+}
+
+//------------------------------------------------
+// Copy with non-temporal (cache bypassing) stores.
+// Unaligned edges use ordinary stores, flushed.
+//
+static void
+memcpy_nt(uint8_t* dst, const uint8_t* src, size_t size)
+{
+#if defined(__x86_64__)
+	size_t head = (16 - ((uint64_t)dst & 15)) & 15;
+
+	if (head > size) {
+		head = size;
+	}
+
+	if (head != 0) {
+		memcpy(dst, src, head);
+		flush_lines(dst, head);
+		dst += head;
+		src += head;
+		size -= head;
+	}
+
+	size_t n_vecs = size / 16;
+
+	for (size_t i = 0; i < n_vecs; i++) {
+		__m128i v = _mm_loadu_si128((const __m128i*)src);
+
+		_mm_stream_si128((__m128i*)dst, v);
+		dst += 16;
+		src += 16;
+	}
+
+	size_t tail = size & 15;
+
+	if (tail != 0) {
+		memcpy(dst, src, tail);
+		flush_lines(dst, tail);
+	}
+#else
+	memcpy(dst, src, size);
+#endif
+}
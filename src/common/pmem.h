@@ -0,0 +1,59 @@
+/*
+ * pmem.h
+ *
+ * Copyright (c) 2018 Aerospike, Inc. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// How writes to a mapped file are made durable.
+typedef enum {
+	PMEM_PERSIST_NONE,  // plain memcpy, left in the CPU cache
+	PMEM_PERSIST_NT,    // non-temporal stores, then sfence
+	PMEM_PERSIST_CLWB   // memcpy, write back each cache line, then sfence
+} pmem_persist_mode;
+
+#define PMEM_CACHE_LINE_SIZE 64
+
+
+//==========================================================
+// Public API.
+//
+
+uint8_t* pmem_map(const char* name, uint64_t size, uint64_t* p_size);
+void pmem_probe();
+void pmem_read(void* dst, const uint8_t* src, size_t size);
+void pmem_unmap(uint8_t* base, uint64_t size);
+void pmem_write(uint8_t* dst, const void* src, size_t size,
+		pmem_persist_mode mode);
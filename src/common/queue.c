@@ -36,6 +36,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 
 //==========================================================
@@ -49,7 +52,11 @@
 // Forward Declarations
 //
 
+uint64_t q_now_ns();
+int q_pop_futex(queue* q, void* ele_ptr, int ms_wait);
 int q_resize(queue* q, uint new_sz);
+int q_spin(queue* q, int ms_wait);
+void q_take(queue* q, void* ele_ptr);
 void q_unwrap(queue* q);
 
 
@@ -61,6 +68,19 @@ void q_unwrap(queue* q);
 #define Q_EMPTY(_q) (_q->write_offset == _q->read_offset)
 #define Q_ELE_PTR(_q, _i) (&_q->elements[(_i % _q->alloc_sz) * _q->ele_size])
 
+// Unlocked peek, for spinning only.
+#define Q_LOOKS_EMPTY(_q) \
+	(*(volatile uint32_t*)&_q->write_offset == \
+			*(volatile uint32_t*)&_q->read_offset)
+
+#if defined(__x86_64__)
+#define Q_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define Q_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define Q_CPU_RELAX()
+#endif
+
 
 //==========================================================
 // Public API.
@@ -91,6 +111,10 @@ queue_create(size_t ele_size, bool thread_safe)
 	q->write_offset = q->read_offset = 0;
 	q->ele_size = ele_size;
 	q->thread_safe = thread_safe;
+	q->park_mode = QUEUE_PARK_CONDVAR;
+	q->spin_us = 0;
+	q->futex_seq = 0;
+	q->n_parked = 0;
 
 	if (! q->thread_safe) {
 		return q;
@@ -177,8 +201,22 @@ queue_push(queue* q, const void* ele_ptr)
 	}
 
 	if (q->thread_safe) {
-		pthread_cond_signal(&q->cond_var);
+		bool wake = false;
+
+		if (q->park_mode == QUEUE_PARK_FUTEX) {
+			q->futex_seq++;
+			wake = q->n_parked != 0;
+		}
+		else {
+			pthread_cond_signal(&q->cond_var);
+		}
+
 		pthread_mutex_unlock(&q->lock);
+
+		if (wake) {
+			syscall(SYS_futex, &q->futex_seq, FUTEX_WAKE_PRIVATE, 1, NULL,
+					NULL, 0);
+		}
 	}
 
 	return QUEUE_OK;
@@ -194,6 +232,16 @@ queue_push(queue* q, const void* ele_ptr)
 int
 queue_pop(queue* q, void* ele_ptr, int ms_wait)
 {
+	if (q->thread_safe && ms_wait != QUEUE_NO_WAIT) {
+		if (q->spin_us != 0) {
+			ms_wait = q_spin(q, ms_wait);
+		}
+
+		if (q->park_mode == QUEUE_PARK_FUTEX) {
+			return q_pop_futex(q, ele_ptr, ms_wait);
+		}
+	}
+
 	if (q->thread_safe) {
 		pthread_mutex_lock(&q->lock);
 	}
@@ -238,12 +286,7 @@ queue_pop(queue* q, void* ele_ptr, int ms_wait)
 		return QUEUE_EMPTY;
 	}
 
-	memcpy(ele_ptr, Q_ELE_PTR(q, q->read_offset), q->ele_size);
-	q->read_offset++;
-
-	if (q->read_offset == q->write_offset) {
-		q->read_offset = q->write_offset = 0;
-	}
+	q_take(q, ele_ptr);
 
 	if (q->thread_safe) {
 		pthread_mutex_unlock(&q->lock);
@@ -252,11 +295,94 @@ queue_pop(queue* q, void* ele_ptr, int ms_wait)
 	return QUEUE_OK;
 }
 
+//------------------------------------------------
+// Choose how queue_pop() waits on an empty
+// thread-safe queue - spin for up to spin_us
+// first, then sleep on the condition variable or
+// a futex. Spinning trades CPU for lower handoff
+// latency, and the futex avoids the condition
+// variable's absolute-deadline timed waits. Call
+// before the queue is in use.
+//
+void
+queue_set_wait(queue* q, queue_park_mode park_mode, uint32_t spin_us)
+{
+	q->park_mode = park_mode;
+	q->spin_us = spin_us;
+}
+
 
 //==========================================================
 // Local helpers.
 //
 
+//------------------------------------------------
+// Monotonic clock for spin and futex deadlines.
+//
+uint64_t
+q_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+//------------------------------------------------
+// Pop, sleeping on a futex while empty - pushes
+// bump futex_seq, and wake a sleeper if any.
+//
+int
+q_pop_futex(queue* q, void* ele_ptr, int ms_wait)
+{
+	uint64_t deadline_ns = ms_wait > 0 ?
+			q_now_ns() + ((uint64_t)ms_wait * 1000000) : 0;
+
+	pthread_mutex_lock(&q->lock);
+
+	while (Q_EMPTY(q)) {
+		struct timespec timeout;
+		struct timespec* p_timeout = NULL;
+
+		if (ms_wait == QUEUE_NO_WAIT) {
+			pthread_mutex_unlock(&q->lock);
+			return QUEUE_EMPTY;
+		}
+
+		if (ms_wait > 0) {
+			uint64_t now_ns = q_now_ns();
+
+			if (now_ns >= deadline_ns) {
+				pthread_mutex_unlock(&q->lock);
+				return QUEUE_EMPTY;
+			}
+
+			timeout.tv_sec = (time_t)((deadline_ns - now_ns) / 1000000000);
+			timeout.tv_nsec = (long)((deadline_ns - now_ns) % 1000000000);
+			p_timeout = &timeout;
+		}
+
+		uint32_t seq = q->futex_seq;
+
+		q->n_parked++;
+		pthread_mutex_unlock(&q->lock);
+
+		// Returns at once if a push already bumped futex_seq.
+		syscall(SYS_futex, &q->futex_seq, FUTEX_WAIT_PRIVATE, seq, p_timeout,
+				NULL, 0);
+
+		pthread_mutex_lock(&q->lock);
+		q->n_parked--;
+	}
+
+	q_take(q, ele_ptr);
+
+	pthread_mutex_unlock(&q->lock);
+
+	return QUEUE_OK;
+}
+
 //------------------------------------------------
 // Change allocated capacity - called under lock.
 //
@@ -304,6 +430,52 @@ q_resize(queue* q, uint new_sz)
 	return QUEUE_OK;
 }
 
+//------------------------------------------------
+// Spin until the queue looks non-empty, for up to
+// spin_us (or ms_wait if shorter). Returns what's
+// left of ms_wait.
+//
+int
+q_spin(queue* q, int ms_wait)
+{
+	uint64_t spin_ns = (uint64_t)q->spin_us * 1000;
+
+	if (ms_wait > 0 && spin_ns > (uint64_t)ms_wait * 1000000) {
+		spin_ns = (uint64_t)ms_wait * 1000000;
+	}
+
+	uint64_t start_ns = q_now_ns();
+	uint64_t spun_ns = 0;
+
+	while (Q_LOOKS_EMPTY(q) && (spun_ns = q_now_ns() - start_ns) < spin_ns) {
+		Q_CPU_RELAX();
+	}
+
+	if (ms_wait < 0) {
+		return ms_wait;
+	}
+
+	int ms_left = ms_wait - (int)(spun_ns / 1000000);
+
+	// Whatever happened, we waited - don't sleep again for nothing.
+	return ms_left > 0 ? ms_left : QUEUE_NO_WAIT;
+}
+
+//------------------------------------------------
+// Copy out and remove the head element - called
+// under lock, if thread-safe, and not empty.
+//
+void
+q_take(queue* q, void* ele_ptr)
+{
+	memcpy(ele_ptr, Q_ELE_PTR(q, q->read_offset), q->ele_size);
+	q->read_offset++;
+
+	if (q->read_offset == q->write_offset) {
+		q->read_offset = q->write_offset = 0;
+	}
+}
+
 //------------------------------------------------
 // Reset read & write offsets - called under lock.
 //
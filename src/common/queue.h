@@ -38,6 +38,12 @@
 // Typedefs & constants.
 //
 
+// How an idle queue_pop() sleeps - see queue_set_wait():
+typedef enum {
+	QUEUE_PARK_CONDVAR,
+	QUEUE_PARK_FUTEX
+} queue_park_mode;
+
 typedef struct queue_s {
 	bool thread_safe;
 	uint32_t alloc_sz;          // number of elements currently allocated
@@ -46,6 +52,10 @@ typedef struct queue_s {
 	size_t ele_size;            // size of (every) element in bytes
 	pthread_mutex_t lock;       // the lock - used in thread-safe mode
 	pthread_cond_t cond_var;    // the conditional variable
+	queue_park_mode park_mode;  // how queue_pop() sleeps when empty
+	uint32_t spin_us;           // how long queue_pop() spins before sleeping
+	uint32_t futex_seq;         // bumped by every push - futex park mode
+	uint32_t n_parked;          // poppers sleeping on futex_seq
 	uint8_t* elements;          // the elements' bytes
 } queue;
 
@@ -68,3 +78,4 @@ void queue_destroy(queue* q);
 uint32_t queue_sz(queue* q);
 int queue_push(queue* q, const void* ele_ptr);
 int queue_pop(queue* q, void* ele_ptr, int ms_wait);
+void queue_set_wait(queue* q, queue_park_mode park_mode, uint32_t spin_us);
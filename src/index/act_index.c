@@ -50,9 +50,13 @@
 #include "common/atomic.h"
 #include "common/cfg.h"
 #include "common/clock.h"
+#include "common/cpu_time.h"
+#include "common/disk_stats.h"
 #include "common/hardware.h"
 #include "common/histogram.h"
 #include "common/io.h"
+#include "common/pacer.h"
+#include "common/perf.h"
 #include "common/queue.h"
 #include "common/random.h"
 #include "common/trace.h"
@@ -68,11 +72,13 @@
 typedef struct device_s {
 	const char* name;
 	uint64_t n_io_offsets;
-	queue* fd_q;
+	queue* read_fd_q;
+	queue* write_fd_q;
 	histogram* raw_read_hist;
 	histogram* raw_write_hist;
 	char read_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 5];
 	char write_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 6];
+	disk_stats stats;
 } device;
 
 typedef struct trans_req_s {
@@ -84,6 +90,12 @@ typedef struct trans_req_s {
 #define IO_SIZE 4096
 #define BUNDLE_SIZE 100
 
+// Throttling - back off the load factor after an interval in which we shed
+// anything, otherwise recover it gradually.
+#define THROTTLE_BACKOFF 0.75
+#define THROTTLE_RECOVERY 0.05
+#define THROTTLE_MIN_FACTOR 0.01
+
 
 //==========================================================
 // Forward declarations.
@@ -93,13 +105,23 @@ static void* run_cache_simulation(void* pv_unused);
 static void* run_generate_read_reqs(void* pv_unused);
 static void* run_transactions(void* pv_req_q);
 
+static void adjust_throttle();
 static bool discover_device(device* dev);
 static void fd_close_all(device* dev);
-static int fd_get(device* dev);
-static void fd_put(device* dev, int fd);
+static int fd_get(device* dev, bool is_write);
+static void fd_put(device* dev, int fd, bool is_write);
 static void read_and_report(trans_req* read_req, uint8_t* buf);
 static void read_cache_and_report(uint8_t* buf);
 static uint64_t read_from_device(device* dev, uint64_t offset, uint8_t* buf);
+static void report_cpu();
+static void report_perf();
+static void report_overload(bool has_write_load);
+static void report_rate(const char* tag, histogram* lag_hist,
+		uint32_t ops_per_point, uint64_t* p_last_total,
+		double requested_per_sec, double interval_sec);
+static void report_rates(bool has_write_load);
+static bool shed_lag(pacer* pace, atomic64* n_shed);
+static bool shed_req();
 static void write_cache_and_report(uint8_t* buf);
 static uint64_t write_to_device(device* dev, uint64_t offset,
 		const uint8_t* buf);
@@ -117,10 +139,31 @@ static uint64_t g_run_start_us;
 
 static atomic32 g_reqs_queued = 0;
 
+// CPU accounting, per thread pool.
+static cpu_group* g_cpu_cache;
+static cpu_group* g_cpu_generators;
+static cpu_group* g_cpu_transactions;
+
+// Hardware & software counters, per thread pool - see 'perf-counters'.
+static perf_group* g_perf_generators;
+static perf_group* g_perf_transactions;
+
+// Overload handling - see 'on-overload'.
+static atomic64 g_reqs_shed = 0;
+static atomic64 g_reqs_late = 0;
+static atomic64 g_cache_ops_shed = 0;
+static atomic64 g_cache_ops_late = 0;
+static volatile bool g_overloaded = false; // shed anything since last interval
+static volatile double g_throttle_factor = 1.0;
+
 static histogram* g_raw_read_hist;
 static histogram* g_raw_write_hist;
 static histogram* g_trans_read_hist;
 
+// Schedule lag - how late each op (or cache op bundle) is issued, per stream.
+static histogram* g_lag_read_hist;
+static histogram* g_lag_cache_hist;
+
 
 //==========================================================
 // Inlines & macros.
@@ -173,17 +216,39 @@ main(int argc, char* argv[])
 
 	if (! (g_raw_read_hist = histogram_create(scale)) ||
 		! (g_raw_write_hist = histogram_create(scale)) ||
-		! (g_trans_read_hist = histogram_create(scale))) {
+		! (g_trans_read_hist = histogram_create(scale)) ||
+		! (g_lag_read_hist = histogram_create(scale)) ||
+		! (g_lag_cache_hist = histogram_create(scale))) {
 		exit(-1);
 	}
 
+	if (! (g_cpu_cache = cpu_group_create("cache", g_icfg.cache_threads)) ||
+		! (g_cpu_generators = cpu_group_create("generators",
+			g_icfg.service_threads)) ||
+		! (g_cpu_transactions = cpu_group_create("transactions",
+			g_icfg.num_queues * g_icfg.threads_per_queue))) {
+		exit(-1);
+	}
+
+	if (g_icfg.perf_counters) {
+		perf_probe();
+
+		if (! (g_perf_generators = perf_group_create("generators",
+				g_icfg.service_threads)) ||
+			! (g_perf_transactions = perf_group_create("transactions",
+				g_icfg.num_queues * g_icfg.threads_per_queue))) {
+			exit(-1);
+		}
+	}
+
 	for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
 		device* dev = &g_devices[d];
 
 		dev->name = (const char*)g_icfg.device_names[d];
 		set_scheduler(dev->name, g_icfg.scheduler_mode);
 
-		if (! (dev->fd_q = queue_create(sizeof(int), true)) ||
+		if (! (dev->read_fd_q = queue_create(sizeof(int), true)) ||
+			! (dev->write_fd_q = queue_create(sizeof(int), true)) ||
 			! discover_device(dev) ||
 			! (dev->raw_read_hist = histogram_create(scale)) ||
 			! (dev->raw_write_hist = histogram_create(scale))) {
@@ -192,6 +257,8 @@ main(int argc, char* argv[])
 
 		sprintf(dev->read_hist_tag, "%s-reads", dev->name);
 		sprintf(dev->write_hist_tag, "%s-writes", dev->name);
+
+		disk_stats_init(dev->name, &dev->stats);
 	}
 
 	rand_seed();
@@ -212,6 +279,10 @@ main(int argc, char* argv[])
 				fprintf(stdout, "ERROR: create cache thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_cache, cache_tids[n])) {
+				exit(-1);
+			}
 		}
 	}
 
@@ -224,11 +295,17 @@ main(int argc, char* argv[])
 		}
 
 		for (uint32_t j = 0; j < g_icfg.threads_per_queue; j++) {
-			if (pthread_create(&trans_tids[(i * g_icfg.threads_per_queue) + j],
-					NULL, run_transactions, (void*)g_trans_qs[i]) != 0) {
+			pthread_t* p_tid = &trans_tids[(i * g_icfg.threads_per_queue) + j];
+
+			if (pthread_create(p_tid, NULL, run_transactions,
+					(void*)g_trans_qs[i]) != 0) {
 				fprintf(stdout, "ERROR: create transaction thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_transactions, *p_tid)) {
+				exit(-1);
+			}
 		}
 	}
 
@@ -240,6 +317,10 @@ main(int argc, char* argv[])
 			fprintf(stdout, "ERROR: create read request thread\n");
 			exit(-1);
 		}
+
+		if (! cpu_group_add(g_cpu_generators, rw_req_generator_tids[k])) {
+			exit(-1);
+		}
 	}
 
 	fprintf(stdout, "\nHISTOGRAM NAMES\n");
@@ -251,12 +332,16 @@ main(int argc, char* argv[])
 		fprintf(stdout, "%s\n", g_devices[d].read_hist_tag);
 	}
 
+	fprintf(stdout, "lag-reads\n");
+
 	if (has_write_load) {
 		fprintf(stdout, "device-writes\n");
 
 		for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
 			fprintf(stdout, "%s\n", g_devices[d].write_hist_tag);
 		}
+
+		fprintf(stdout, "lag-cache-ops\n");
 	}
 
 	fprintf(stdout, "\n");
@@ -281,6 +366,21 @@ main(int argc, char* argv[])
 		fprintf(stdout, "requests-queued: %" PRIu32 "\n",
 				atomic32_get(g_reqs_queued));
 
+		report_rates(has_write_load);
+		report_cpu();
+
+		if (g_icfg.perf_counters) {
+			report_perf();
+		}
+
+		for (uint32_t d = 0; d < g_icfg.num_devices; d++) {
+			disk_stats_report(g_devices[d].name, &g_devices[d].stats);
+		}
+
+		if (g_icfg.on_overload != OVERLOAD_STOP) {
+			report_overload(has_write_load);
+		}
+
 		histogram_dump(g_trans_read_hist, "trans-reads");
 		histogram_dump(g_raw_read_hist, "device-reads");
 
@@ -289,6 +389,8 @@ main(int argc, char* argv[])
 					g_devices[d].read_hist_tag);
 		}
 
+		histogram_dump(g_lag_read_hist, "lag-reads");
+
 		if (has_write_load) {
 			histogram_dump(g_raw_write_hist, "device-writes");
 
@@ -296,6 +398,8 @@ main(int argc, char* argv[])
 				histogram_dump(g_devices[d].raw_write_hist,
 						g_devices[d].write_hist_tag);
 			}
+
+			histogram_dump(g_lag_cache_hist, "lag-cache-ops");
 		}
 
 		fprintf(stdout, "\n");
@@ -326,7 +430,8 @@ main(int argc, char* argv[])
 		device* dev = &g_devices[d];
 
 		fd_close_all(dev);
-		queue_destroy(dev->fd_q);
+		queue_destroy(dev->read_fd_q);
+		queue_destroy(dev->write_fd_q);
 		free(dev->raw_read_hist);
 		free(dev->raw_write_hist);
 	}
@@ -334,6 +439,16 @@ main(int argc, char* argv[])
 	free(g_raw_read_hist);
 	free(g_raw_write_hist);
 	free(g_trans_read_hist);
+	free(g_lag_read_hist);
+	free(g_lag_cache_hist);
+	free(g_cpu_cache);
+	free(g_cpu_generators);
+	free(g_cpu_transactions);
+
+	if (g_icfg.perf_counters) {
+		perf_group_destroy(g_perf_generators);
+		perf_group_destroy(g_perf_transactions);
+	}
 
 	return 0;
 }
@@ -356,29 +471,37 @@ run_cache_simulation(void* pv_unused)
 	uint8_t stack_buffer[IO_SIZE + 4096];
 	uint8_t* buf = align_4096(stack_buffer);
 
-	uint64_t target_factor =
-			1000000ull * g_icfg.num_devices * g_icfg.cache_threads;
+	pacer pace;
 
-	uint64_t count = 0;
+	pacer_init(&pace, g_run_start_us,
+			(double)g_icfg.cache_thread_reads_and_writes_per_sec /
+					(g_icfg.num_devices * g_icfg.cache_threads),
+			g_throttle_factor);
 
 	while (g_running) {
+		histogram_insert_data_point(g_lag_cache_hist,
+				pacer_lag_us(&pace) * 1000);
+
 		for (uint32_t i = 0; i < BUNDLE_SIZE; i++) {
 			read_cache_and_report(buf);
 			write_cache_and_report(buf);
 		}
 
-		count += BUNDLE_SIZE;
+		// Each cache op is a device read and a device write.
+		cpu_group_count(g_cpu_cache, 2 * BUNDLE_SIZE, 2 * BUNDLE_SIZE * IO_SIZE);
 
-		// TODO - someday (count * target_factor) may overflow a uint64_t.
-		uint64_t target_us = (count * target_factor) /
-				g_icfg.cache_thread_reads_and_writes_per_sec;
+		int64_t sleep_us =
+				pacer_next_sleep_us(&pace, BUNDLE_SIZE, g_throttle_factor);
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+		if (sleep_us < 0) {
+			atomic64_add(&g_cache_ops_late, BUNDLE_SIZE);
+		}
 
 		if (sleep_us > 0) {
 			usleep((uint32_t)sleep_us);
 		}
-		else if (sleep_us < -(int64_t)g_icfg.max_lag_usec) {
+		else if (sleep_us < -(int64_t)g_icfg.max_lag_usec &&
+				! shed_lag(&pace, &g_cache_ops_shed)) {
 			fprintf(stdout, "ERROR: cache thread device IO can't keep up\n");
 			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
 			g_running = false;
@@ -396,42 +519,56 @@ run_cache_simulation(void* pv_unused)
 static void*
 run_generate_read_reqs(void* pv_unused)
 {
+	if (g_icfg.perf_counters) {
+		perf_group_add_self(g_perf_generators);
+	}
+
 	rand_seed_thread();
 
-	uint64_t count = 0;
-	uint64_t trans_thread_reads_per_sec =
-			g_icfg.trans_thread_reads_per_sec / g_icfg.service_threads;
+	pacer pace;
+
+	pacer_init(&pace, g_run_start_us,
+			(double)g_icfg.trans_thread_reads_per_sec / g_icfg.service_threads,
+			g_throttle_factor);
 
 	while (g_running) {
 		if (atomic32_incr(&g_reqs_queued) > g_icfg.max_reqs_queued) {
-			fprintf(stdout, "ERROR: too many requests queued\n");
-			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
-			g_running = false;
-			break;
+			if (! shed_req()) {
+				fprintf(stdout, "ERROR: too many requests queued\n");
+				fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+				g_running = false;
+				break;
+			}
+		}
+		else {
+			uint32_t queue_index = pace.count % g_icfg.num_queues;
+			uint32_t random_dev_index = rand_32() % g_icfg.num_devices;
+			device* random_dev = &g_devices[random_dev_index];
+
+			trans_req read_req = {
+					.dev = random_dev,
+					.offset = random_io_offset(random_dev),
+					.start_time = get_ns()
+			};
+
+			histogram_insert_data_point(g_lag_read_hist,
+					pacer_lag_us(&pace) * 1000);
+
+			queue_push(g_trans_qs[queue_index], &read_req);
+			cpu_group_count(g_cpu_generators, 1, IO_SIZE);
 		}
 
-		uint32_t queue_index = count % g_icfg.num_queues;
-		uint32_t random_dev_index = rand_32() % g_icfg.num_devices;
-		device* random_dev = &g_devices[random_dev_index];
-
-		trans_req read_req = {
-				.dev = random_dev,
-				.offset = random_io_offset(random_dev),
-				.start_time = get_ns()
-		};
-
-		queue_push(g_trans_qs[queue_index], &read_req);
+		int64_t sleep_us = pacer_next_sleep_us(&pace, 1, g_throttle_factor);
 
-		count++;
-
-		int64_t sleep_us = (int64_t)
-				(((count * 1000000) / trans_thread_reads_per_sec) -
-						(get_us() - g_run_start_us));
+		if (sleep_us < 0) {
+			atomic64_incr(&g_reqs_late);
+		}
 
 		if (sleep_us > 0) {
 			usleep((uint32_t)sleep_us);
 		}
-		else if (sleep_us < -(int64_t)g_icfg.max_lag_usec) {
+		else if (sleep_us < -(int64_t)g_icfg.max_lag_usec &&
+				! shed_lag(&pace, &g_reqs_shed)) {
 			fprintf(stdout, "ERROR: read request generator can't keep up\n");
 			fprintf(stdout, "ACT can't do requested load - test stopped\n");
 			fprintf(stdout, "try configuring more 'service-threads'\n");
@@ -450,6 +587,10 @@ run_generate_read_reqs(void* pv_unused)
 static void*
 run_transactions(void* pv_req_q)
 {
+	if (g_icfg.perf_counters) {
+		perf_group_add_self(g_perf_transactions);
+	}
+
 	queue* req_q = (queue*)pv_req_q;
 	trans_req read_req;
 
@@ -462,6 +603,7 @@ run_transactions(void* pv_req_q)
 		uint8_t* buf = align_4096(stack_buffer);
 
 		read_and_report(&read_req, buf);
+		cpu_group_count(g_cpu_transactions, 1, IO_SIZE);
 
 		atomic32_decr(&g_reqs_queued);
 	}
@@ -474,13 +616,37 @@ run_transactions(void* pv_req_q)
 // Local helpers - generic.
 //
 
+//------------------------------------------------
+// Once per interval - back off the load factor if
+// we had to shed anything, else recover it.
+//
+static void
+adjust_throttle()
+{
+	if (g_overloaded) {
+		g_overloaded = false;
+		g_throttle_factor *= THROTTLE_BACKOFF;
+
+		if (g_throttle_factor < THROTTLE_MIN_FACTOR) {
+			g_throttle_factor = THROTTLE_MIN_FACTOR;
+		}
+	}
+	else if (g_throttle_factor < 1.0) {
+		g_throttle_factor += THROTTLE_RECOVERY;
+
+		if (g_throttle_factor > 1.0) {
+			g_throttle_factor = 1.0;
+		}
+	}
+}
+
 //------------------------------------------------
 // Discover device storage capacity, etc.
 //
 static bool
 discover_device(device* dev)
 {
-	int fd = fd_get(dev);
+	int fd = fd_get(dev, true);
 
 	if (fd == -1) {
 		return false;
@@ -489,7 +655,7 @@ discover_device(device* dev)
 	uint64_t device_bytes = 0;
 
 	ioctl(fd, BLKGETSIZE64, &device_bytes);
-	fd_put(dev, fd);
+	fd_put(dev, fd, true);
 
 	if (device_bytes == 0) {
 		fprintf(stdout, "ERROR: %s ioctl to discover size\n", dev->name);
@@ -511,7 +677,11 @@ fd_close_all(device* dev)
 {
 	int fd;
 
-	while (queue_pop(dev->fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
+	while (queue_pop(dev->read_fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
+		close(fd);
+	}
+
+	while (queue_pop(dev->write_fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
 		close(fd);
 	}
 }
@@ -520,13 +690,20 @@ fd_close_all(device* dev)
 // Get a safe file descriptor for a device.
 //
 static int
-fd_get(device* dev)
+fd_get(device* dev, bool is_write)
 {
 	int fd = -1;
 
-	if (queue_pop(dev->fd_q, (void*)&fd, QUEUE_NO_WAIT) != QUEUE_OK) {
-		int direct_flags = O_DIRECT | (g_icfg.disable_odsync ? 0 : O_DSYNC);
-		fd = open(dev->name, O_RDWR | direct_flags, S_IRUSR | S_IWUSR);
+	queue* fd_q = is_write ? dev->write_fd_q : dev->read_fd_q;
+
+	if (queue_pop(fd_q, (void*)&fd, QUEUE_NO_WAIT) != QUEUE_OK) {
+		int flags = O_RDONLY | O_DIRECT;
+
+		if (is_write) {
+			flags = O_RDWR | O_DIRECT | (g_icfg.disable_odsync ? 0 : O_DSYNC);
+		}
+
+		fd = open(dev->name, flags, S_IRUSR | S_IWUSR);
 
 		if (fd == -1) {
 			fprintf(stdout, "ERROR: open device %s errno %d '%s'\n", dev->name,
@@ -541,9 +718,9 @@ fd_get(device* dev)
 // Recycle a safe file descriptor for a device.
 //
 static void
-fd_put(device* dev, int fd)
+fd_put(device* dev, int fd, bool is_write)
 {
-	queue_push(dev->fd_q, (void*)&fd);
+	queue_push(is_write ? dev->write_fd_q : dev->read_fd_q, (void*)&fd);
 }
 
 //------------------------------------------------
@@ -592,7 +769,7 @@ read_cache_and_report(uint8_t* buf)
 static uint64_t
 read_from_device(device* dev, uint64_t offset, uint8_t* buf)
 {
-	int fd = fd_get(dev);
+	int fd = fd_get(dev, false);
 
 	if (fd == -1) {
 		return -1;
@@ -607,11 +784,187 @@ read_from_device(device* dev, uint64_t offset, uint8_t* buf)
 
 	uint64_t stop_ns = get_ns();
 
-	fd_put(dev, fd);
+	fd_put(dev, fd, false);
 
 	return stop_ns;
 }
 
+//------------------------------------------------
+// Report CPU time and cost for this interval, per
+// thread pool in use.
+//
+static void
+report_cpu()
+{
+	cpu_group* groups[] = {
+			g_cpu_generators,
+			g_cpu_transactions,
+			g_cpu_cache
+	};
+
+	for (uint32_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+		if (groups[i]->n_threads != 0) {
+			cpu_group_report(groups[i]);
+		}
+	}
+}
+
+//------------------------------------------------
+// Report overload counts for this interval, and
+// adjust throttling if configured.
+//
+static void
+report_overload(bool has_write_load)
+{
+	static uint64_t last_reqs_shed = 0;
+	static uint64_t last_reqs_late = 0;
+	static uint64_t last_cache_ops_shed = 0;
+	static uint64_t last_cache_ops_late = 0;
+
+	uint64_t reqs_shed = atomic64_get(g_reqs_shed);
+	uint64_t reqs_late = atomic64_get(g_reqs_late);
+	uint64_t cache_ops_shed = atomic64_get(g_cache_ops_shed);
+	uint64_t cache_ops_late = atomic64_get(g_cache_ops_late);
+
+	fprintf(stdout, "requests-shed: %" PRIu64 "\n", reqs_shed - last_reqs_shed);
+	fprintf(stdout, "requests-late: %" PRIu64 "\n", reqs_late - last_reqs_late);
+
+	if (has_write_load) {
+		fprintf(stdout, "cache-ops-shed: %" PRIu64 "\n",
+				cache_ops_shed - last_cache_ops_shed);
+		fprintf(stdout, "cache-ops-late: %" PRIu64 "\n",
+				cache_ops_late - last_cache_ops_late);
+	}
+
+	last_reqs_shed = reqs_shed;
+	last_reqs_late = reqs_late;
+	last_cache_ops_shed = cache_ops_shed;
+	last_cache_ops_late = cache_ops_late;
+
+	if (g_icfg.on_overload == OVERLOAD_THROTTLE) {
+		adjust_throttle();
+		fprintf(stdout, "throttle-factor: %.3lf\n", g_throttle_factor);
+	}
+	else {
+		g_overloaded = false;
+	}
+}
+
+//------------------------------------------------
+// Report counters for this interval, per thread
+// pool in use.
+//
+static void
+report_perf()
+{
+	perf_group* groups[] = {
+			g_perf_generators,
+			g_perf_transactions
+	};
+
+	for (uint32_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+		if (atomic32_get(groups[i]->n_threads) != 0) {
+			perf_group_report(groups[i]);
+		}
+	}
+}
+
+//------------------------------------------------
+// Report a stream's achieved issue rate for this
+// interval, against the rate its pacers targeted.
+// Every issued op (or cache op bundle) has a lag
+// data point, so we use the lag histogram's total
+// for the issue count.
+//
+static void
+report_rate(const char* tag, histogram* lag_hist, uint32_t ops_per_point,
+		uint64_t* p_last_total, double requested_per_sec, double interval_sec)
+{
+	uint64_t total = histogram_get_total(lag_hist);
+
+	fprintf(stdout, "achieved-%s-per-sec: %.1lf of %.1lf\n", tag,
+			(double)((total - *p_last_total) * ops_per_point) / interval_sec,
+			requested_per_sec);
+
+	*p_last_total = total;
+}
+
+//------------------------------------------------
+// Report achieved vs. requested issue rates for
+// this interval. Called before any throttle
+// adjustment, so g_throttle_factor is what applied
+// over the interval.
+//
+static void
+report_rates(bool has_write_load)
+{
+	static uint64_t last_report_us = 0;
+	static uint64_t last_reads = 0;
+	static uint64_t last_cache_bundles = 0;
+
+	uint64_t now_us = get_us() - g_run_start_us;
+	double interval_sec = (double)(now_us - last_report_us) / 1000000.0;
+
+	last_report_us = now_us;
+
+	if (interval_sec <= 0.0) {
+		return;
+	}
+
+	report_rate("reads", g_lag_read_hist, 1, &last_reads,
+			g_icfg.trans_thread_reads_per_sec * g_throttle_factor,
+			interval_sec);
+
+	// Note - cache threads are paced at the configured rate divided by the
+	// number of devices.
+	if (has_write_load) {
+		report_rate("cache-ops", g_lag_cache_hist, BUNDLE_SIZE,
+				&last_cache_bundles,
+				(double)g_icfg.cache_thread_reads_and_writes_per_sec /
+						g_icfg.num_devices * g_throttle_factor,
+				interval_sec);
+	}
+}
+
+//------------------------------------------------
+// If configured to, skip ahead when an op stream
+// lags too far behind, and count the skipped ops
+// as shed. Returns false if we should stop the
+// test instead.
+//
+static bool
+shed_lag(pacer* pace, atomic64* n_shed)
+{
+	if (g_icfg.on_overload == OVERLOAD_STOP) {
+		return false;
+	}
+
+	atomic64_add(n_shed, (int64_t)pacer_skip(pace));
+	g_overloaded = true;
+
+	return true;
+}
+
+//------------------------------------------------
+// If configured to, drop a request that would
+// exceed max-reqs-queued, and count it as shed.
+// Returns false if we should stop the test
+// instead.
+//
+static bool
+shed_req()
+{
+	if (g_icfg.on_overload == OVERLOAD_STOP) {
+		return false;
+	}
+
+	atomic32_decr(&g_reqs_queued);
+	atomic64_incr(&g_reqs_shed);
+	g_overloaded = true;
+
+	return true;
+}
+
 //------------------------------------------------
 // Do one cache thread write operation and report.
 //
@@ -642,7 +995,7 @@ write_cache_and_report(uint8_t* buf)
 static uint64_t
 write_to_device(device* dev, uint64_t offset, const uint8_t* buf)
 {
-	int fd = fd_get(dev);
+	int fd = fd_get(dev, true);
 
 	if (fd == -1) {
 		return -1;
@@ -657,7 +1010,7 @@ write_to_device(device* dev, uint64_t offset, const uint8_t* buf)
 
 	uint64_t stop_ns = get_ns();
 
-	fd_put(dev, fd);
+	fd_put(dev, fd, true);
 
 	return stop_ns;
 }
@@ -54,6 +54,7 @@ static const char TAG_CACHE_THREADS[]           = "cache-threads";
 static const char TAG_TEST_DURATION_SEC[]       = "test-duration-sec";
 static const char TAG_REPORT_INTERVAL_SEC[]     = "report-interval-sec";
 static const char TAG_MICROSECOND_HISTOGRAMS[]  = "microsecond-histograms";
+static const char TAG_PERF_COUNTERS[]           = "perf-counters";
 static const char TAG_READ_REQS_PER_SEC[]       = "read-reqs-per-sec";
 static const char TAG_WRITE_REQS_PER_SEC[]      = "write-reqs-per-sec";
 static const char TAG_REPLICATION_FACTOR[]      = "replication-factor";
@@ -61,6 +62,7 @@ static const char TAG_DEFRAG_LWM_PCT[]          = "defrag-lwm-pct";
 static const char TAG_DISABLE_ODSYNC[]          = "disable-odsync";
 static const char TAG_MAX_REQS_QUEUED[]         = "max-reqs-queued";
 static const char TAG_MAX_LAG_SEC[]             = "max-lag-sec";
+static const char TAG_ON_OVERLOAD[]             = "on-overload";
 static const char TAG_SCHEDULER_MODE[]          = "scheduler-mode";
 
 
@@ -151,6 +153,9 @@ index_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MICROSECOND_HISTOGRAMS) == 0) {
 			g_icfg.us_histograms = parse_yes_no();
 		}
+		else if (strcmp(tag, TAG_PERF_COUNTERS) == 0) {
+			g_icfg.perf_counters = parse_yes_no();
+		}
 		else if (strcmp(tag, TAG_READ_REQS_PER_SEC) == 0) {
 			g_icfg.read_reqs_per_sec = parse_uint32();
 		}
@@ -172,6 +177,9 @@ index_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MAX_LAG_SEC) == 0) {
 			g_icfg.max_lag_usec = (uint64_t)parse_uint32() * 1000000;
 		}
+		else if (strcmp(tag, TAG_ON_OVERLOAD) == 0) {
+			g_icfg.on_overload = parse_overload_mode();
+		}
 		else if (strcmp(tag, TAG_SCHEDULER_MODE) == 0) {
 			g_icfg.scheduler_mode = parse_scheduler_mode();
 		}
@@ -310,6 +318,8 @@ echo_configuration()
 			g_icfg.report_interval_us / 1000000);
 	fprintf(stdout, "%s: %s\n", TAG_MICROSECOND_HISTOGRAMS,
 			g_icfg.us_histograms ? "yes" : "no");
+	fprintf(stdout, "%s: %s\n", TAG_PERF_COUNTERS,
+			g_icfg.perf_counters ? "yes" : "no");
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_READ_REQS_PER_SEC,
 			g_icfg.read_reqs_per_sec);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_WRITE_REQS_PER_SEC,
@@ -324,6 +334,8 @@ echo_configuration()
 			g_icfg.max_reqs_queued);
 	fprintf(stdout, "%s: %" PRIu64 "\n", TAG_MAX_LAG_SEC,
 			g_icfg.max_lag_usec / 1000000);
+	fprintf(stdout, "%s: %s\n", TAG_ON_OVERLOAD,
+			OVERLOAD_MODES[g_icfg.on_overload]);
 	fprintf(stdout, "%s: %s\n", TAG_SCHEDULER_MODE,
 			g_icfg.scheduler_mode);
 
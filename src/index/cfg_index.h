@@ -50,6 +50,7 @@ typedef struct index_cfg_s {
 	uint64_t run_us;                // converted from literal units in seconds
 	uint64_t report_interval_us;    // converted from literal units in seconds
 	bool us_histograms;
+	bool perf_counters;
 	uint32_t read_reqs_per_sec;
 	uint32_t write_reqs_per_sec;
 	uint32_t replication_factor;
@@ -57,6 +58,7 @@ typedef struct index_cfg_s {
 	bool disable_odsync;
 	uint32_t max_reqs_queued;
 	uint64_t max_lag_usec;          // converted from literal units in seconds
+	overload_mode on_overload;
 	const char* scheduler_mode;
 
 	// Derived from literal configuration:
@@ -29,57 +29,132 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/fs.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 
+#include "common/atomic.h"
+#include "common/clock.h"
 #include "common/hardware.h"
 #include "common/io.h"
 #include "common/random.h"
 #include "common/trace.h"
+#include "common/version.h"
 
 
 //==========================================================
 // Typedefs & constants.
 //
 
-#define NUM_SALT_THREADS 8
-#define NUM_ZERO_THREADS 8
+#define NUM_CHECK_THREADS 8
+#define THREADS_PER_DEVICE 8
 #define LARGE_BLOCK_BYTES (1024 * 128)
 
+#define MAX_NUM_DEVICES 128
+#define PROGRESS_INTERVAL_SEC 10
+
+#define DEFAULT_CHECK_BLOCKS 1024
+
+// Salted blocks are ~8.0 bits/byte - anything real data-like is well below.
+#define MIN_SALTED_ENTROPY 7.9
+
+#define SIGNATURE_MAGIC "ACT-PREP-SIG"
+
+// Written at the start of the device's last large block, if requested.
+typedef struct prep_signature_s {
+	char magic[16];
+	char version[16];
+	uint64_t prep_time;         // seconds since epoch, when salting finished
+	uint64_t device_bytes;
+	uint32_t large_block_bytes;
+	uint32_t num_zero_threads;
+	uint32_t num_salt_threads;
+} prep_signature;
+
+typedef struct check_counts_s {
+	uint64_t n_zeroed;
+	uint64_t n_salted;
+	uint64_t n_other;
+	uint64_t n_failed;
+} check_counts;
+
+typedef struct prep_device_s {
+	const char* name;
+	uint64_t device_bytes;
+	uint64_t n_large_blocks;
+	uint64_t extra_bytes;       // fractional large block at end of device
+	uint32_t n_threads;         // this device's share of the thread budget
+	bool numa_local;            // if false, threads aren't pinned
+	cpu_set_t numa_cpus;
+	atomic64 bytes_done;        // in current phase
+	uint64_t last_report_bytes;
+	check_counts check_counts[NUM_CHECK_THREADS];
+} prep_device;
+
+typedef struct prep_thread_s {
+	prep_device* dev;
+	uint32_t n;
+	pthread_t tid;
+	bool failed;                // didn't do its whole share of the phase
+} prep_thread;
+
+// Exit codes for --check mode.
+#define CHECK_SALTED 0
+#define CHECK_NEEDS_PREP 1
+#define CHECK_NEEDS_SALT 2
+
 
 //==========================================================
 // Forward declarations.
 //
 
-static void* run_salt(void* pv_n);
-static void* run_zero(void* pv_n);
+static void* run_check(void* pv_thread);
+static void* run_salt(void* pv_thread);
+static void* run_zero(void* pv_thread);
 
 static uint8_t* act_valloc(size_t size);
+static int check_device(prep_device* dev);
+static void check_signature(prep_device* dev);
 static bool create_zero_buffer();
-static bool discover_num_blocks();
+static bool discover_device(prep_device* dev);
+static bool is_salted(const uint8_t* buf);
+static bool is_zeroed(const uint8_t* buf);
+static bool parse_args(int argc, char* argv[]);
+static void pin_thread(const prep_device* dev);
+static void report_progress(const char* phase, uint64_t elapsed_us,
+		uint64_t interval_us, bool done);
+static bool run_phase(const char* phase, void* (*run)(void*));
+static void throttle(uint64_t bytes);
+static bool write_signature(prep_device* dev);
 
 
 //==========================================================
 // Globals.
 //
 
-static char* g_device_name = NULL;
-static uint64_t g_num_large_blocks = 0;
+static prep_device g_devices[MAX_NUM_DEVICES];
+static uint32_t g_num_devices = 0;
+static bool g_check = false;
+static bool g_sign = false;
+static uint64_t g_check_blocks = DEFAULT_CHECK_BLOCKS;
+static uint32_t g_num_threads = 0; // total budget - default is per device
+static uint64_t g_max_bytes_per_sec = 0; // total across devices, 0 = no limit
 static uint8_t* g_p_zero_buffer = NULL;
-static uint64_t g_blocks_per_salt_thread = 0;
-static uint64_t g_blocks_per_zero_thread = 0;
-static uint64_t g_extra_blocks_to_zero = 0;
-static uint64_t g_extra_blocks_to_salt = 0;
-static uint64_t g_extra_bytes_to_zero = 0;
+
+static atomic32 g_threads_running = 0;
+static atomic64 g_phase_bytes = 0;
+static uint64_t g_phase_start_us = 0;
 
 
 //==========================================================
@@ -87,11 +162,17 @@ static uint64_t g_extra_bytes_to_zero = 0;
 //
 
 static inline int
-fd_get()
+fd_get(const prep_device* dev)
 {
 	// Note - not bothering to set O_DSYNC. Rigor is unnecessary for salting,
 	// and we're not trying to measure performance here - just go fast.
-	return open(g_device_name, O_DIRECT | O_RDWR, S_IRUSR | S_IWUSR);
+	return open(dev->name, O_DIRECT | O_RDWR, S_IRUSR | S_IWUSR);
+}
+
+static inline double
+mbytes_per_sec(uint64_t bytes, uint64_t us)
+{
+	return us == 0 ? 0.0 : (double)bytes / (double)us; // bytes/us = MB/s
 }
 
 
@@ -104,43 +185,74 @@ main(int argc, char* argv[])
 {
 	signal_setup();
 
-	if (argc != 2) {
-		fprintf(stdout, "usage: act_prep [device name]\n");
+	if (! parse_args(argc, argv)) {
+		fprintf(stdout, "usage: act_prep [--check [--check-blocks n]] "
+				"[--sign] [--threads n] [--max-mbytes-per-sec n] "
+				"[device name] ...\n");
 		exit(0);
 	}
 
-	char device_name[strlen(argv[1]) + 1];
+	for (uint32_t d = 0; d < g_num_devices; d++) {
+		prep_device* dev = &g_devices[d];
 
-	strcpy(device_name, argv[1]);
-	g_device_name = device_name;
-
-	set_scheduler(g_device_name, "noop");
+		if (! g_check) {
+			set_scheduler(dev->name, "noop");
+		}
 
-	if (! discover_num_blocks()) {
-		exit(-1);
+		if (! discover_device(dev)) {
+			exit(-1);
+		}
 	}
 
-	//------------------------
-	// Begin zeroing.
+	rand_seed();
 
-	fprintf(stdout, "cleaning device %s\n", g_device_name);
+	if (g_check) {
+		int result = CHECK_SALTED;
 
-	if (! create_zero_buffer()) {
-		exit(-1);
+		// Report the worst - error, then full prep, then salting only.
+		for (uint32_t d = 0; d < g_num_devices; d++) {
+			int dev_result = check_device(&g_devices[d]);
+
+			if (dev_result < 0 || (result >= 0 &&
+					(dev_result == CHECK_NEEDS_PREP ||
+							(dev_result == CHECK_NEEDS_SALT &&
+									result == CHECK_SALTED)))) {
+				result = dev_result;
+			}
+		}
+
+		exit(result);
 	}
 
-	pthread_t zero_threads[NUM_ZERO_THREADS];
+	// Share the thread budget evenly, at least one thread per device.
+	uint32_t budget = g_num_threads == 0 ?
+			THREADS_PER_DEVICE * g_num_devices : g_num_threads;
 
-	for (uint32_t n = 0; n < NUM_ZERO_THREADS; n++) {
-		if (pthread_create(&zero_threads[n], NULL, run_zero,
-				(void*)(uint64_t)n) != 0) {
-			fprintf(stdout, "ERROR: creating zero thread %" PRIu32 "\n", n);
-			exit(-1);
+	for (uint32_t d = 0; d < g_num_devices; d++) {
+		prep_device* dev = &g_devices[d];
+
+		dev->n_threads = budget / g_num_devices +
+				(d < budget % g_num_devices ? 1 : 0);
+
+		if (dev->n_threads == 0) {
+			dev->n_threads = 1;
 		}
+
+		fprintf(stdout, "%s: %" PRIu32 " threads, %s\n", dev->name,
+				dev->n_threads, dev->numa_local ?
+						"pinned to local NUMA node" : "not pinned");
+	}
+
+	if (g_max_bytes_per_sec != 0) {
+		fprintf(stdout, "total throughput limited to %" PRIu64 " MB/s\n",
+				g_max_bytes_per_sec / 1000000);
 	}
 
-	for (uint32_t n = 0; n < NUM_ZERO_THREADS; n++) {
-		pthread_join(zero_threads[n], NULL);
+	//------------------------
+	// Begin zeroing.
+
+	if (! create_zero_buffer() || ! run_phase("cleaning", run_zero)) {
+		exit(-1);
 	}
 
 	free(g_p_zero_buffer);
@@ -148,24 +260,25 @@ main(int argc, char* argv[])
 	//------------------------
 	// Begin salting.
 
-	fprintf(stdout, "salting device %s\n", g_device_name);
+	if (! run_phase("salting", run_salt)) {
+		exit(-1);
+	}
 
-	rand_seed();
+	if (g_sign) {
+		bool signed_all = true;
 
-	pthread_t salt_threads[NUM_SALT_THREADS];
+		// Try every device, even if one fails.
+		for (uint32_t d = 0; d < g_num_devices; d++) {
+			if (! write_signature(&g_devices[d])) {
+				signed_all = false;
+			}
+		}
 
-	for (uint32_t n = 0; n < NUM_SALT_THREADS; n++) {
-		if (pthread_create(&salt_threads[n], NULL, run_salt,
-				(void*)(uint64_t)n) != 0) {
-			fprintf(stdout, "ERROR: creating salt thread %" PRIu32 "\n", n);
+		if (! signed_all) {
 			exit(-1);
 		}
 	}
 
-	for (uint32_t n = 0; n < NUM_SALT_THREADS; n++) {
-		pthread_join(salt_threads[n], NULL);
-	}
-
 	return 0;
 }
 
@@ -175,144 +288,207 @@ main(int argc, char* argv[])
 //
 
 //------------------------------------------------
-// Runs in all (NUM_SALT_THREADS) salt_threads,
-// salts a portion of the device.
+// Runs in all (NUM_CHECK_THREADS) check threads
+// per device, reads and classifies a share of the
+// random sample blocks.
 //
 static void*
-run_salt(void* pv_n)
+run_check(void* pv_thread)
 {
 	rand_seed_thread();
 
-	uint32_t n = (uint32_t)(uint64_t)pv_n;
+	prep_device* dev = ((prep_thread*)pv_thread)->dev;
+	uint32_t n = ((prep_thread*)pv_thread)->n;
+	check_counts* counts = &dev->check_counts[n];
 
-	uint64_t offset = n * g_blocks_per_salt_thread * LARGE_BLOCK_BYTES;
-	uint64_t blocks_to_salt = g_blocks_per_salt_thread;
-	uint64_t progress_blocks = 0;
-	bool last_thread = n + 1 == NUM_SALT_THREADS;
+	uint8_t* buf = act_valloc(LARGE_BLOCK_BYTES);
 
-	if (last_thread) {
-		blocks_to_salt += g_extra_blocks_to_salt;
-		progress_blocks = blocks_to_salt / 100;
+	if (! buf) {
+		fprintf(stdout, "ERROR: valloc in check thread\n");
+		return NULL;
+	}
+
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		fprintf(stdout, "ERROR: open in check thread\n");
+		free(buf);
+		return NULL;
+	}
 
-		if (! progress_blocks) {
-			progress_blocks = 1;
+	// Spread any remainder over the first threads.
+	uint64_t blocks_to_check = g_check_blocks / NUM_CHECK_THREADS +
+			(n < g_check_blocks % NUM_CHECK_THREADS ? 1 : 0);
+
+	for (uint64_t b = 0; b < blocks_to_check; b++) {
+		uint64_t offset = (rand_64() % dev->n_large_blocks) * LARGE_BLOCK_BYTES;
+
+		if (! pread_all(fd, buf, LARGE_BLOCK_BYTES, offset)) {
+			counts->n_failed++;
+			continue;
+		}
+
+		if (is_zeroed(buf)) {
+			counts->n_zeroed++;
+		}
+		else if (is_salted(buf)) {
+			counts->n_salted++;
+		}
+		else {
+			counts->n_other++;
 		}
 	}
 
-//	fprintf(stdout, "thread %d: blks-to-salt = %" PRIu64 ", prg-blks = %"
-//			PRIu64 "\n", n, blocks_to_salt, progress_blocks);
+	close(fd);
+	free(buf);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Runs in all of a device's salt threads, salts
+// a portion of the device.
+//
+static void*
+run_salt(void* pv_thread)
+{
+	rand_seed_thread();
+
+	prep_thread* thread = (prep_thread*)pv_thread;
+	prep_device* dev = thread->dev;
+	uint32_t n = thread->n;
+
+	pin_thread(dev);
+
+	uint64_t blocks_per_thread = dev->n_large_blocks / dev->n_threads;
+	uint64_t offset = n * blocks_per_thread * LARGE_BLOCK_BYTES;
+	uint64_t blocks_to_salt = blocks_per_thread;
+	bool last_thread = n + 1 == dev->n_threads;
+
+	if (last_thread) {
+		blocks_to_salt += dev->n_large_blocks % dev->n_threads;
+	}
 
 	uint8_t* buf = act_valloc(LARGE_BLOCK_BYTES);
 
 	if (! buf) {
-		fprintf(stdout, "ERROR: valloc in salt thread %" PRIu32 "\n", n);
+		fprintf(stdout, "ERROR: valloc in %s salt thread %" PRIu32 "\n",
+				dev->name, n);
+		thread->failed = true;
+		atomic32_decr(&g_threads_running);
 		return NULL;
 	}
 
-	int fd = fd_get();
+	int fd = fd_get(dev);
 
 	if (fd == -1) {
-		fprintf(stdout, "ERROR: open in salt thread %" PRIu32 "\n", n);
+		fprintf(stdout, "ERROR: open in %s salt thread %" PRIu32 "\n",
+				dev->name, n);
 		free(buf);
+		thread->failed = true;
+		atomic32_decr(&g_threads_running);
 		return NULL;
 	}
 
 	if (lseek(fd, offset, SEEK_SET) != offset) {
-		fprintf(stdout, "ERROR: seek in salt thread %" PRIu32 "\n", n);
+		fprintf(stdout, "ERROR: seek in %s salt thread %" PRIu32 "\n",
+				dev->name, n);
 		close(fd);
 		free(buf);
+		thread->failed = true;
+		atomic32_decr(&g_threads_running);
 		return NULL;
 	}
 
 	for (uint64_t b = 0; b < blocks_to_salt; b++) {
 		if (! rand_fill(buf, LARGE_BLOCK_BYTES)) {
-			fprintf(stdout, "ERROR: rand fill in salt thread %" PRIu32 "\n", n);
+			fprintf(stdout, "ERROR: rand fill in %s salt thread %" PRIu32 "\n",
+					dev->name, n);
+			thread->failed = true;
 			break;
 		}
 
 		if (! write_all(fd, buf, LARGE_BLOCK_BYTES)) {
-			fprintf(stdout, "ERROR: write in salt thread %" PRIu32 "\n", n);
+			fprintf(stdout, "ERROR: write in %s salt thread %" PRIu32 "\n",
+					dev->name, n);
+			thread->failed = true;
 			break;
 		}
 
-		if (progress_blocks && ! (b % progress_blocks)) {
-			fprintf(stdout, ".");
-			fflush(stdout);
-		}
-	}
-
-	if (progress_blocks) {
-		fprintf(stdout, "\n");
+		atomic64_add(&dev->bytes_done, LARGE_BLOCK_BYTES);
+		throttle(LARGE_BLOCK_BYTES);
 	}
 
 	close(fd);
 	free(buf);
+	atomic32_decr(&g_threads_running);
 
 	return NULL;
 }
 
 //------------------------------------------------
-// Runs in all (NUM_ZERO_THREADS) zero_threads,
-// zeros a portion of the device.
+// Runs in all of a device's zero threads, zeros a
+// portion of the device.
 //
 static void*
-run_zero(void* pv_n)
+run_zero(void* pv_thread)
 {
-	uint32_t n = (uint32_t)(uint64_t)pv_n;
+	prep_thread* thread = (prep_thread*)pv_thread;
+	prep_device* dev = thread->dev;
+	uint32_t n = thread->n;
 
-	uint64_t offset = n * g_blocks_per_zero_thread * LARGE_BLOCK_BYTES;
-	uint64_t blocks_to_zero = g_blocks_per_zero_thread;
-	uint64_t progress_blocks = 0;
-	bool last_thread = n + 1 == NUM_ZERO_THREADS;
+	pin_thread(dev);
 
-	if (last_thread) {
-		blocks_to_zero += g_extra_blocks_to_zero;
-		progress_blocks = blocks_to_zero / 100;
+	uint64_t blocks_per_thread = dev->n_large_blocks / dev->n_threads;
+	uint64_t offset = n * blocks_per_thread * LARGE_BLOCK_BYTES;
+	uint64_t blocks_to_zero = blocks_per_thread;
+	bool last_thread = n + 1 == dev->n_threads;
 
-		if (! progress_blocks) {
-			progress_blocks = 1;
-		}
+	if (last_thread) {
+		blocks_to_zero += dev->n_large_blocks % dev->n_threads;
 	}
 
-//	fprintf(stdout, "thread %d: blks-to-zero = %" PRIu64 ", prg-blks = %"
-//			PRIu64 "\n", n, blocks_to_zero, progress_blocks);
-
-	int fd = fd_get();
+	int fd = fd_get(dev);
 
 	if (fd == -1) {
-		fprintf(stdout, "ERROR: open in zero thread %" PRIu32 "\n", n);
+		fprintf(stdout, "ERROR: open in %s zero thread %" PRIu32 "\n",
+				dev->name, n);
+		thread->failed = true;
+		atomic32_decr(&g_threads_running);
 		return NULL;
 	}
 
 	if (lseek(fd, offset, SEEK_SET) != offset) {
-		fprintf(stdout, "ERROR: seek in zero thread %" PRIu32 "\n", n);
+		fprintf(stdout, "ERROR: seek in %s zero thread %" PRIu32 "\n",
+				dev->name, n);
 		close(fd);
+		thread->failed = true;
+		atomic32_decr(&g_threads_running);
 		return NULL;
 	}
 
 	for (uint64_t b = 0; b < blocks_to_zero; b++) {
 		if (! write_all(fd, g_p_zero_buffer, LARGE_BLOCK_BYTES)) {
-			fprintf(stdout, "ERROR: write in zero thread %" PRIu32 "\n", n);
+			fprintf(stdout, "ERROR: write in %s zero thread %" PRIu32 "\n",
+					dev->name, n);
+			thread->failed = true;
 			break;
 		}
 
-		if (progress_blocks && ! (b % progress_blocks)) {
-			fprintf(stdout, ".");
-			fflush(stdout);
-		}
-	}
-
-	if (progress_blocks) {
-		fprintf(stdout, "\n");
+		atomic64_add(&dev->bytes_done, LARGE_BLOCK_BYTES);
+		throttle(LARGE_BLOCK_BYTES);
 	}
 
-	if (last_thread) {
-		if (! write_all(fd, g_p_zero_buffer, g_extra_bytes_to_zero)) {
-			fprintf(stdout, "ERROR: write in zero thread %" PRIu32 "\n", n);
+	if (last_thread && dev->extra_bytes != 0) {
+		if (! write_all(fd, g_p_zero_buffer, dev->extra_bytes)) {
+			fprintf(stdout, "ERROR: write in %s zero thread %" PRIu32 "\n",
+					dev->name, n);
+			thread->failed = true;
 		}
 	}
 
 	close(fd);
+	atomic32_decr(&g_threads_running);
 
 	return NULL;
 }
@@ -333,6 +509,121 @@ act_valloc(size_t size)
 	return posix_memalign(&pv, 4096, size) == 0 ? (uint8_t*)pv : NULL;
 }
 
+//------------------------------------------------
+// Sample random large blocks and decide whether
+// the device still needs preparing. Returns the
+// process exit code.
+//
+static int
+check_device(prep_device* dev)
+{
+	fprintf(stdout, "checking device %s\n", dev->name);
+
+	check_signature(dev);
+
+	prep_thread check_threads[NUM_CHECK_THREADS];
+
+	memset(dev->check_counts, 0, sizeof(dev->check_counts));
+
+	for (uint32_t n = 0; n < NUM_CHECK_THREADS; n++) {
+		check_threads[n].dev = dev;
+		check_threads[n].n = n;
+
+		if (pthread_create(&check_threads[n].tid, NULL, run_check,
+				(void*)&check_threads[n]) != 0) {
+			fprintf(stdout, "ERROR: creating check thread %" PRIu32 "\n", n);
+			exit(-1);
+		}
+	}
+
+	check_counts total = { 0 };
+
+	for (uint32_t n = 0; n < NUM_CHECK_THREADS; n++) {
+		pthread_join(check_threads[n].tid, NULL);
+
+		total.n_zeroed += dev->check_counts[n].n_zeroed;
+		total.n_salted += dev->check_counts[n].n_salted;
+		total.n_other += dev->check_counts[n].n_other;
+		total.n_failed += dev->check_counts[n].n_failed;
+	}
+
+	uint64_t n_checked = total.n_zeroed + total.n_salted + total.n_other;
+
+	fprintf(stdout, "sampled %" PRIu64 " large blocks: %" PRIu64 " salted, %"
+			PRIu64 " zeroed, %" PRIu64 " other, %" PRIu64 " read errors\n",
+			n_checked, total.n_salted, total.n_zeroed, total.n_other,
+			total.n_failed);
+
+	if (n_checked == 0 || total.n_failed != 0) {
+		fprintf(stdout, "ERROR: couldn't sample device %s\n", dev->name);
+		return -1;
+	}
+
+	if (total.n_salted == n_checked) {
+		fprintf(stdout, "%s is salted - no prep needed\n", dev->name);
+		return CHECK_SALTED;
+	}
+
+	if (total.n_zeroed == n_checked) {
+		fprintf(stdout, "%s is clean - needs salting\n", dev->name);
+		return CHECK_NEEDS_SALT;
+	}
+
+	fprintf(stdout, "%s needs cleaning and salting\n", dev->name);
+
+	return CHECK_NEEDS_PREP;
+}
+
+//------------------------------------------------
+// Report a previously written signature, if any.
+//
+static void
+check_signature(prep_device* dev)
+{
+	uint8_t* buf = act_valloc(LARGE_BLOCK_BYTES);
+
+	if (! buf) {
+		fprintf(stdout, "ERROR: signature buffer act_valloc()\n");
+		return;
+	}
+
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		fprintf(stdout, "ERROR: opening device %s\n", dev->name);
+		free(buf);
+		return;
+	}
+
+	uint64_t offset = (dev->n_large_blocks - 1) * LARGE_BLOCK_BYTES;
+	const prep_signature* sig = (const prep_signature*)buf;
+
+	if (! pread_all(fd, buf, LARGE_BLOCK_BYTES, offset)) {
+		fprintf(stdout, "ERROR: reading signature from %s\n", dev->name);
+	}
+	else if (strncmp(sig->magic, SIGNATURE_MAGIC, sizeof(sig->magic)) != 0 ||
+			sig->device_bytes != dev->device_bytes) {
+		fprintf(stdout, "no prep signature found\n");
+	}
+	else {
+		char date[64];
+		time_t prep_time = (time_t)sig->prep_time;
+		struct tm tm;
+
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S %Z",
+				localtime_r(&prep_time, &tm));
+
+		fprintf(stdout, "prep signature: salted %s by act_prep %.*s, "
+				"large-block %" PRIu32 " bytes, %" PRIu32 " zero threads, %"
+				PRIu32 " salt threads\n", date, (int)sizeof(sig->version),
+				sig->version, sig->large_block_bytes, sig->num_zero_threads,
+				sig->num_salt_threads);
+	}
+
+	close(fd);
+	free(buf);
+}
+
 //------------------------------------------------
 // Allocate and zero one large block sized buffer.
 //
@@ -352,15 +643,15 @@ create_zero_buffer()
 }
 
 //------------------------------------------------
-// Discover device storage capacity.
+// Discover device storage capacity and locality.
 //
 static bool
-discover_num_blocks()
+discover_device(prep_device* dev)
 {
-	int fd = fd_get();
+	int fd = fd_get(dev);
 
 	if (fd == -1) {
-		fprintf(stdout, "ERROR: opening device %s\n", g_device_name);
+		fprintf(stdout, "ERROR: opening device %s\n", dev->name);
 		return false;
 	}
 
@@ -369,17 +660,332 @@ discover_num_blocks()
 	ioctl(fd, BLKGETSIZE64, &device_bytes);
 	close(fd);
 
-	g_num_large_blocks = device_bytes / LARGE_BLOCK_BYTES;
-	g_extra_bytes_to_zero = device_bytes % LARGE_BLOCK_BYTES;
+	dev->device_bytes = device_bytes;
+	dev->n_large_blocks = device_bytes / LARGE_BLOCK_BYTES;
+	dev->extra_bytes = device_bytes % LARGE_BLOCK_BYTES;
+	dev->numa_local = device_numa_cpus(dev->name, &dev->numa_cpus);
 
-	g_blocks_per_zero_thread = g_num_large_blocks / NUM_ZERO_THREADS;
-	g_blocks_per_salt_thread = g_num_large_blocks / NUM_SALT_THREADS;
+	fprintf(stdout, "%s size = %" PRIu64 " bytes, %" PRIu64 " large blocks\n",
+			dev->name, device_bytes, dev->n_large_blocks);
 
-	g_extra_blocks_to_zero = g_num_large_blocks % NUM_ZERO_THREADS;
-	g_extra_blocks_to_salt = g_num_large_blocks % NUM_SALT_THREADS;
+	if (dev->n_large_blocks == 0) {
+		fprintf(stdout, "ERROR: %s ioctl to discover size\n", dev->name);
+		return false;
+	}
 
-	fprintf(stdout, "%s size = %" PRIu64 " bytes, %" PRIu64 " large blocks\n",
-			g_device_name, device_bytes, g_num_large_blocks);
+	return true;
+}
+
+//------------------------------------------------
+// Is the (large block) buffer high-entropy data?
+//
+static bool
+is_salted(const uint8_t* buf)
+{
+	uint32_t counts[256] = { 0 };
+
+	for (uint32_t i = 0; i < LARGE_BLOCK_BYTES; i++) {
+		counts[buf[i]]++;
+	}
+
+	double entropy = 0.0;
+
+	for (uint32_t v = 0; v < 256; v++) {
+		if (counts[v] != 0) {
+			double p = (double)counts[v] / LARGE_BLOCK_BYTES;
+
+			entropy -= p * log2(p);
+		}
+	}
+
+	return entropy >= MIN_SALTED_ENTROPY;
+}
+
+//------------------------------------------------
+// Is the (large block) buffer all zeros?
+//
+static bool
+is_zeroed(const uint8_t* buf)
+{
+	const uint64_t* p_read = (const uint64_t*)buf;
+	const uint64_t* p_end = (const uint64_t*)(buf + LARGE_BLOCK_BYTES);
+
+	while (p_read < p_end) {
+		if (*p_read++ != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Parse command line - options, then device names.
+//
+static bool
+parse_args(int argc, char* argv[])
+{
+	int i = 1;
+
+	for ( ; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+		if (strcmp(argv[i], "--check") == 0) {
+			g_check = true;
+		}
+		else if (strcmp(argv[i], "--check-blocks") == 0 && i + 1 < argc) {
+			g_check_blocks = strtoul(argv[++i], NULL, 10);
+
+			if (g_check_blocks < NUM_CHECK_THREADS) {
+				fprintf(stdout, "ERROR: --check-blocks must be at least %d\n",
+						NUM_CHECK_THREADS);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--sign") == 0) {
+			g_sign = true;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			g_num_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+
+			if (g_num_threads == 0) {
+				fprintf(stdout, "ERROR: --threads must be non-zero\n");
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--max-mbytes-per-sec") == 0 &&
+				i + 1 < argc) {
+			g_max_bytes_per_sec = strtoul(argv[++i], NULL, 10) * 1000000;
+		}
+		else {
+			fprintf(stdout, "ERROR: unknown option '%s'\n", argv[i]);
+			return false;
+		}
+	}
+
+	if (i == argc || (g_check && g_sign)) {
+		return false;
+	}
+
+	for ( ; i < argc; i++) {
+		if (g_num_devices == MAX_NUM_DEVICES) {
+			fprintf(stdout, "ERROR: too many device names\n");
+			return false;
+		}
+
+		g_devices[g_num_devices++].name = argv[i];
+	}
 
 	return true;
 }
+
+//------------------------------------------------
+// Run the calling thread on the CPUs local to the
+// device, if we know them.
+//
+static void
+pin_thread(const prep_device* dev)
+{
+	if (dev->numa_local && sched_setaffinity(0, sizeof(cpu_set_t),
+			&dev->numa_cpus) != 0) {
+		fprintf(stdout, "ERROR: couldn't pin %s thread to NUMA node\n",
+				dev->name);
+	}
+}
+
+//------------------------------------------------
+// Print each device's progress and throughput.
+//
+static void
+report_progress(const char* phase, uint64_t elapsed_us, uint64_t interval_us,
+		bool done)
+{
+	uint64_t total_bytes = 0;
+
+	for (uint32_t d = 0; d < g_num_devices; d++) {
+		prep_device* dev = &g_devices[d];
+		uint64_t bytes = atomic64_get(dev->bytes_done);
+		uint64_t phase_bytes = dev->n_large_blocks * LARGE_BLOCK_BYTES;
+
+		if (done) {
+			fprintf(stdout, "%s: %s done in %" PRIu64 " sec, %.1lf MB/s\n",
+					dev->name, phase, elapsed_us / 1000000,
+					mbytes_per_sec(bytes, elapsed_us));
+		}
+		else {
+			fprintf(stdout, "%s: %s %" PRIu64 "%%, %.1lf MB/s\n", dev->name,
+					phase, (bytes * 100) / phase_bytes,
+					mbytes_per_sec(bytes - dev->last_report_bytes,
+							interval_us));
+		}
+
+		total_bytes += bytes;
+		dev->last_report_bytes = bytes;
+	}
+
+	if (g_num_devices > 1) {
+		fprintf(stdout, "total: %s %.1lf MB/s\n", phase,
+				mbytes_per_sec(total_bytes, elapsed_us));
+	}
+
+	fflush(stdout);
+}
+
+//------------------------------------------------
+// Run a zeroing or salting pass over all devices
+// concurrently, reporting progress periodically.
+// Returns false if any thread didn't finish its
+// share.
+//
+static bool
+run_phase(const char* phase, void* (*run)(void*))
+{
+	fprintf(stdout, "%s %" PRIu32 " device(s)\n", phase, g_num_devices);
+
+	uint32_t n_threads = 0;
+
+	for (uint32_t d = 0; d < g_num_devices; d++) {
+		g_devices[d].bytes_done = 0;
+		g_devices[d].last_report_bytes = 0;
+		n_threads += g_devices[d].n_threads;
+	}
+
+	prep_thread* threads = malloc(n_threads * sizeof(prep_thread));
+
+	if (! threads) {
+		fprintf(stdout, "ERROR: %s threads malloc()\n", phase);
+		return false;
+	}
+
+	g_phase_bytes = 0;
+	g_phase_start_us = get_us();
+	g_threads_running = n_threads;
+
+	prep_thread* thread = threads;
+
+	for (uint32_t d = 0; d < g_num_devices; d++) {
+		for (uint32_t n = 0; n < g_devices[d].n_threads; n++) {
+			thread->dev = &g_devices[d];
+			thread->n = n;
+			thread->failed = false;
+
+			if (pthread_create(&thread->tid, NULL, run, (void*)thread) != 0) {
+				fprintf(stdout, "ERROR: creating %s thread\n", phase);
+				exit(-1);
+			}
+
+			thread++;
+		}
+	}
+
+	uint64_t last_report_us = g_phase_start_us;
+
+	while (atomic32_get(g_threads_running) != 0) {
+		sleep(1);
+
+		uint64_t now_us = get_us();
+
+		if (now_us - last_report_us >= PROGRESS_INTERVAL_SEC * 1000000) {
+			report_progress(phase, now_us - g_phase_start_us,
+					now_us - last_report_us, false);
+			last_report_us = now_us;
+		}
+	}
+
+	bool ok = true;
+	const prep_device* last_failed_dev = NULL;
+
+	for (uint32_t n = 0; n < n_threads; n++) {
+		pthread_join(threads[n].tid, NULL);
+
+		if (threads[n].failed) {
+			// Threads are grouped by device - report each device once.
+			if (threads[n].dev != last_failed_dev) {
+				fprintf(stdout, "ERROR: %s %s incomplete\n", phase,
+						threads[n].dev->name);
+				last_failed_dev = threads[n].dev;
+			}
+
+			ok = false;
+		}
+	}
+
+	free(threads);
+
+	report_progress(phase, get_us() - g_phase_start_us, 0, true);
+
+	return ok;
+}
+
+//------------------------------------------------
+// Hold total throughput across all devices to
+// the configured limit, if any.
+//
+static void
+throttle(uint64_t bytes)
+{
+	if (g_max_bytes_per_sec == 0) {
+		return;
+	}
+
+	uint64_t total_bytes = atomic64_add(&g_phase_bytes, bytes);
+	uint64_t target_us = (total_bytes * 1000000) / g_max_bytes_per_sec;
+	int64_t sleep_us = (int64_t)(target_us - (get_us() - g_phase_start_us));
+
+	if (sleep_us > 0) {
+		usleep((uint32_t)sleep_us);
+	}
+}
+
+//------------------------------------------------
+// Record prep time and parameters at the start
+// of the (already salted) last large block.
+// Returns false if the signature wasn't written.
+//
+static bool
+write_signature(prep_device* dev)
+{
+	uint8_t* buf = act_valloc(LARGE_BLOCK_BYTES);
+
+	if (! buf) {
+		fprintf(stdout, "ERROR: signature buffer act_valloc()\n");
+		return false;
+	}
+
+	// Keep the rest of the block salted.
+	rand_seed_thread();
+	rand_fill(buf, LARGE_BLOCK_BYTES);
+
+	prep_signature* sig = (prep_signature*)buf;
+
+	memset(sig, 0, sizeof(prep_signature));
+	strncpy(sig->magic, SIGNATURE_MAGIC, sizeof(sig->magic));
+	strncpy(sig->version, VERSION, sizeof(sig->version));
+	sig->prep_time = (uint64_t)time(NULL);
+	sig->device_bytes = dev->device_bytes;
+	sig->large_block_bytes = LARGE_BLOCK_BYTES;
+	sig->num_zero_threads = dev->n_threads;
+	sig->num_salt_threads = dev->n_threads;
+
+	int fd = fd_get(dev);
+
+	if (fd == -1) {
+		fprintf(stdout, "ERROR: opening device %s\n", dev->name);
+		free(buf);
+		return false;
+	}
+
+	uint64_t offset = (dev->n_large_blocks - 1) * LARGE_BLOCK_BYTES;
+
+	bool ok = pwrite_all(fd, buf, LARGE_BLOCK_BYTES, offset);
+
+	if (! ok) {
+		fprintf(stdout, "ERROR: writing signature to %s\n", dev->name);
+	}
+	else {
+		fprintf(stdout, "wrote prep signature to %s\n", dev->name);
+	}
+
+	close(fd);
+	free(buf);
+
+	return ok;
+}
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -46,13 +47,22 @@
 #include <linux/fs.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
+#include "common/async_io.h"
 #include "common/atomic.h"
 #include "common/cfg.h"
 #include "common/clock.h"
+#include "common/coroutine.h"
+#include "common/cpu_time.h"
+#include "common/disk_stats.h"
 #include "common/hardware.h"
 #include "common/histogram.h"
 #include "common/io.h"
+#include "common/ioprio.h"
+#include "common/pacer.h"
+#include "common/perf.h"
+#include "common/pmem.h"
 #include "common/queue.h"
 #include "common/random.h"
 #include "common/trace.h"
@@ -65,6 +75,21 @@
 // Typedefs & constants.
 //
 
+// Large-block ops of one kind on one device - its threads share the pacer.
+typedef struct large_block_stream_s {
+	pthread_mutex_t lock;
+	pacer pace;
+	pthread_t* tids;
+} large_block_stream;
+
+// A device's op counts as of the last report - see 'device-*-multipliers'.
+typedef struct device_counts_s {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t large_block_reads;
+	uint64_t large_block_writes;
+} device_counts;
+
 typedef struct device_s {
 	const char* name;
 	uint64_t n_large_blocks;
@@ -76,27 +101,106 @@ typedef struct device_s {
 	uint32_t write_bytes;
 	uint32_t n_read_sizes;
 	uint32_t n_write_sizes;
-	queue* fd_q;
-	pthread_t large_block_read_thread;
-	pthread_t large_block_write_thread;
+	uint32_t record_stored_bytes;   // may be overridden per device
+	uint32_t record_stored_bytes_rmx;
+	double read_share;              // of each stream's total rate
+	double write_share;
+	double large_block_share;
+	atomic64 n_large_block_reads;
+	atomic64 n_large_block_writes;
+	device_counts last_counts;      // only if per-device rates configured
+	queue* read_fd_q;
+	queue* write_fd_q;
+	uint8_t* pmem_base;             // pmem mode only
+	uint64_t pmem_bytes;            // pmem mode only
+	large_block_stream large_block_reads;
+	large_block_stream large_block_writes;
+	pthread_t partial_flush_thread;
+	atomic64 n_recent_writes;       // only if recent-read-pct configured
+	uint64_t* recent_offsets;       // ring of recent large-block writes
+	const char* shadow_name;        // only if shadow devices configured
+	int shadow_fd;
+	queue* shadow_q;                // offsets of large-block writes to mirror
+	pthread_t shadow_thread;
 	pthread_t tomb_raider_thread;
 	histogram* raw_read_hist;
 	histogram* raw_write_hist;
 	char read_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 5];
 	char write_hist_tag[MAX_DEVICE_NAME_SIZE + 1 + 6];
+	disk_stats stats;
 } device;
 
-typedef struct trans_req_s {
-	device* dev;
-	uint64_t offset;
-	uint32_t size;
-	bool is_write;
-	uint64_t start_time;
-} trans_req;
+// Transaction coroutines - see 'coroutines-per-thread'.
+typedef struct trans_coroutine_s {
+	coroutine* co;
+	trans_req req;
+	uint8_t* buf;
+	bool busy;                      // has a request, may be waiting for IO
+	int64_t io_res;                 // result of the IO it waited for
+} trans_coroutine;
+
+#define COROUTINE_STACK_SIZE (64 * 1024)
+
+// How long a transaction thread waits for IO completions before checking
+// for new requests, while some of its coroutines are idle.
+#define COROUTINE_POLL_NS (100 * 1000)
+
+typedef struct stream_stats_s {
+	uint64_t n_ops;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+} stream_stats;
+
+typedef struct load_step_s {
+	double multiplier;
+	uint64_t duration_us;
+	stream_stats reads;
+	stream_stats writes;
+	stream_stats large_block_reads;
+	stream_stats large_block_writes;
+} load_step;
+
+// Whether a buffered read was served from the page cache.
+typedef enum {
+	CACHE_UNKNOWN,
+	CACHE_HIT,
+	CACHE_MISS
+} cache_result;
 
 #define LO_IO_MIN_SIZE 512
 #define HI_IO_MIN_SIZE 4096
 
+// Index devices - same IO as act_index.
+#define INDEX_IO_SIZE 4096
+
+// Streams with configurable IO priority - transaction, large-block (including
+// shadow), tomb raider and index cache.
+#define N_IOPRIO_STREAMS 4
+
+typedef struct ioprio_hist_s {
+	int ioprio;
+	histogram* hist;
+	char tag[7 + IOPRIO_NAME_SIZE];
+} ioprio_hist;
+
+// Knee detection for load sweeps - a step "keeps up" if it achieves this
+// fraction of its requested rate ...
+#define KNEE_MIN_RATE_FRACTION 0.95
+// ... and its 99th percentile latency is within this factor of the first
+// step's.
+#define KNEE_MAX_P99_GROWTH 2
+
+// Throttling - back off the load factor after an interval in which we shed
+// anything, otherwise recover it gradually.
+#define THROTTLE_BACKOFF 0.75
+#define THROTTLE_RECOVERY 0.05
+#define THROTTLE_MIN_FACTOR 0.01
+
+// Adaptive transaction thread pool - how often a parked thread checks whether
+// it's needed again.
+#define TRANS_PARK_US (10 * 1000)
+
 
 //==========================================================
 // Forward declarations.
@@ -104,26 +208,75 @@ typedef struct trans_req_s {
 
 static void* run_generate_read_reqs(void* pv_unused);
 static void* run_generate_write_reqs(void* pv_unused);
+static void* run_index_cache(void* pv_unused);
 static void* run_large_block_reads(void* pv_dev);
 static void* run_large_block_writes(void* pv_dev);
+static void* run_partial_flushes(void* pv_dev);
+static void* run_shadow_writes(void* pv_dev);
 static void* run_tomb_raider(void* pv_dev);
-static void* run_transactions(void* pv_req_q);
+static void* run_transactions(void* pv_n);
 
+static void add_ioprio_hist(int ioprio, histogram_scale scale);
+static void adjust_throttle();
+static void adjust_trans_threads();
 static uint8_t* act_valloc(size_t size);
+static bool device_io(int fd, bool is_write, uint8_t* buf, uint32_t size,
+		uint64_t offset);
 static bool discover_device(device* dev);
 static uint64_t discover_min_op_bytes(int fd, const char* name);
+static bool discover_index_device(device* dev);
 static void discover_read_pattern(device* dev);
+static bool discover_shadow(device* dev);
 static void discover_write_pattern(device* dev);
+static void do_transaction(trans_req* req, uint8_t* buf);
+static void drop_page_cache();
+static void end_load_step(uint64_t duration_us);
 static void fd_close_all(device* dev);
-static int fd_get(device* dev);
-static void fd_put(device* dev, int fd);
+static int fd_get(device* dev, bool is_write);
+static void fd_put(device* dev, int fd, bool is_write);
+static uint64_t large_block_async_io(device* dev, uint64_t offset, uint8_t* buf,
+		bool is_write, histogram* chunk_hist);
+static uint64_t large_block_io(device* dev, uint64_t offset, uint8_t* buf,
+		bool is_write);
+static uint32_t max_trans_req_bytes();
+static bool pace_large_block_op(large_block_stream* stream,
+		histogram* lag_hist);
+static bool pop_trans_req(queue* req_q, uint32_t q_index, trans_req* req,
+		int ms_wait);
+static void queue_shadow_write(device* dev, uint64_t offset);
 static void read_and_report(trans_req* read_req, uint8_t* buf);
 static void read_and_report_large_block(device* dev, uint8_t* buf);
+static void read_index_and_report(uint8_t* buf);
 static uint64_t read_from_device(device* dev, uint64_t offset, uint32_t size,
-		uint8_t* buf);
+		uint8_t* buf, cache_result* p_cache);
+static void report_cpu();
+static void report_device_rates(double interval_sec, double factor);
+static void report_endurance_projection();
+static void report_generator_lag();
+static void report_load_steps();
+static void report_perf();
+static void report_pmem_bytes();
+static void report_overload();
+static void report_rate(const char* tag, histogram* lag_hist,
+		uint64_t* p_last_total, double requested_per_sec, double interval_sec);
+static void report_rates();
+static void report_shadow_backlog();
+static void report_steals();
+static void report_write_bytes();
+static void run_trans_coroutine(void* pv_tc);
+static void schedule_trans_coroutines(queue* req_q, uint32_t q_index,
+		uint32_t slot);
+static void set_thread_ioprio(int ioprio);
+static bool shed_lag(pacer* pace, atomic64* n_shed);
+static bool shed_req();
+static bool start_large_block_stream(device* dev, large_block_stream* stream,
+		double ops_per_sec, void* (*run)(void*));
+static bool steal_req(uint32_t own_q_index, trans_req* req);
+static void step_stats(histogram* h, uint64_t* start_counts,
+		stream_stats* stats);
+static void stop_large_block_stream(large_block_stream* stream);
 static void write_and_report(trans_req* write_req, uint8_t* buf);
-static void write_and_report_large_block(device* dev, uint8_t* buf,
-		uint64_t count);
+static void write_and_report_large_block(device* dev, uint8_t* buf);
 static uint64_t write_to_device(device* dev, uint64_t offset, uint32_t size,
 		const uint8_t* buf);
 
@@ -133,6 +286,7 @@ static uint64_t write_to_device(device* dev, uint64_t offset, uint32_t size,
 //
 
 static device* g_devices;
+static device* g_index_devices;
 static queue** g_trans_qs;
 
 static volatile bool g_running;
@@ -147,6 +301,100 @@ static histogram* g_read_hist;
 static histogram* g_raw_write_hist;
 static histogram* g_write_hist;
 
+// Schedule lag - how late each op is issued, per stream.
+static histogram* g_lag_read_hist;
+static histogram* g_lag_write_hist;
+static histogram* g_lag_large_block_read_hist;
+static histogram* g_lag_large_block_write_hist;
+
+// Large-block ops split into chunks - see 'large-block-chunk-kbytes'.
+static histogram* g_chunk_large_block_read_hist;
+static histogram* g_chunk_large_block_write_hist;
+static __thread aio_context_t tl_aio_ctx;
+
+// Transaction coroutine running on this thread, if any.
+static __thread trans_coroutine* tl_trans_co;
+
+// Buffered IO - device reads split by page cache hit or miss.
+static histogram* g_cache_hit_read_hist;
+static histogram* g_cache_miss_read_hist;
+
+// Bytes written to the device(s), per stream.
+static atomic64 g_commit_write_bytes = 0;
+static atomic64 g_large_block_write_bytes = 0;
+static atomic64 g_shadow_write_bytes = 0;
+static atomic64 g_index_write_bytes = 0;
+
+// Index devices - see 'device-roles'.
+static histogram* g_index_read_hist;
+static histogram* g_index_write_hist;
+static histogram* g_lag_index_cache_hist;
+static atomic64 g_index_cache_ops_shed = 0;
+static atomic64 g_index_cache_ops_late = 0;
+
+// Reads split by recently written or not - see 'recent-read-pct'.
+static histogram* g_recent_read_hist;
+static histogram* g_cold_read_hist;
+
+// Time from queueing a request to a transaction thread taking it - see
+// 'queue-park' and 'queue-spin-usec'.
+static histogram* g_handoff_hist;
+
+// Partial-block flushes - see 'flush-max-ms'.
+static histogram* g_partial_flush_write_hist;
+static atomic64 g_partial_flush_write_bytes = 0;
+
+// Shadow devices - see 'shadow-device-names'.
+static histogram* g_shadow_write_hist;
+static atomic64 g_shadow_writes_shed = 0;
+
+// Device IO latency per IO priority - see '*-ioprio'.
+static ioprio_hist g_ioprio_hists[N_IOPRIO_STREAMS];
+static uint32_t g_num_ioprio_hists = 0;
+static __thread histogram* tl_ioprio_hist = NULL;
+
+// Bytes copied to and from mapped files - see 'pmem'.
+static atomic64 g_pmem_read_bytes = 0;
+static atomic64 g_pmem_write_bytes = 0;
+
+// CPU accounting, per thread pool.
+static cpu_group* g_cpu_generators;
+static cpu_group* g_cpu_index_cache;
+static cpu_group* g_cpu_large_block;
+static cpu_group* g_cpu_shadow;
+static cpu_group* g_cpu_tomb_raider;
+static cpu_group* g_cpu_transactions;
+
+// Hardware & software counters, per thread pool - see 'perf-counters'.
+static perf_group* g_perf_generators;
+static perf_group* g_perf_transactions;
+
+// Load sweep - pacers pick up changes to the load factor on the fly.
+static volatile double g_load_factor = 1.0;
+static load_step g_load_steps[MAX_NUM_LOAD_STEPS];
+static uint32_t g_num_steps_done = 0;
+static uint64_t g_step_read_counts[N_BUCKETS];
+static uint64_t g_step_write_counts[N_BUCKETS];
+static uint64_t g_step_large_block_read_counts[N_BUCKETS];
+static uint64_t g_step_large_block_write_counts[N_BUCKETS];
+
+// Overload handling - see 'on-overload'.
+static atomic64 g_reqs_shed = 0;
+static atomic64 g_reqs_late = 0;
+static atomic64 g_reqs_stolen = 0;
+
+// Worst request generator lag this interval - see 'service-threads'.
+static atomic64 g_max_generator_lag_us = 0;
+
+// Adaptive transaction thread pool - see 'threads-per-queue-max'.
+static atomic32 g_trans_threads_active;   // per queue
+static atomic64 g_queue_wait_ns = 0;
+static atomic64 g_queue_waits = 0;
+static atomic64 g_large_block_ops_shed = 0;
+static atomic64 g_large_block_ops_late = 0;
+static volatile bool g_overloaded = false; // shed anything since last interval
+static volatile double g_throttle_factor = 1.0;
+
 
 //==========================================================
 // Inlines & macros.
@@ -158,6 +406,67 @@ align_4096(const uint8_t* stack_buffer)
 	return (uint8_t*)(((uint64_t)stack_buffer + 4095) & ~4095ULL);
 }
 
+static inline bool
+buffered_io()
+{
+	return g_scfg.file_size != 0 && ! g_scfg.file_direct_io;
+}
+
+// Whether large-block ops are split into chunks submitted all at once.
+static inline bool
+parallel_chunks()
+{
+	return g_scfg.large_block_chunk_bytes != 0 &&
+			g_scfg.large_block_chunk_mode == CHUNK_MODE_PARALLEL;
+}
+
+static inline void
+note_generator_lag(int64_t sleep_us)
+{
+	// Racy, but good enough for a warning.
+	if ((uint64_t)-sleep_us > atomic64_get(g_max_generator_lag_us)) {
+		atomic64_set(&g_max_generator_lag_us, (uint64_t)-sleep_us);
+	}
+}
+
+static inline uint32_t
+max_threads_per_queue()
+{
+	return g_scfg.threads_per_queue_max != 0 ?
+			g_scfg.threads_per_queue_max : g_scfg.threads_per_queue;
+}
+
+static inline bool
+trans_thread_active(uint32_t slot)
+{
+	return slot < atomic32_get(g_trans_threads_active);
+}
+
+static inline void
+resume_trans_coroutine(trans_coroutine* tc)
+{
+	tl_trans_co = tc;
+	coroutine_resume(tc->co);
+	tl_trans_co = NULL;
+}
+
+static inline double
+load_factor()
+{
+	return g_load_factor * g_throttle_factor;
+}
+
+// Logical bytes per second that clients write, at a given load factor.
+static inline double
+client_write_bytes_per_sec(double factor)
+{
+	uint32_t record_bytes_max = g_scfg.record_bytes_rmx == 0 ?
+			g_scfg.record_bytes : g_scfg.record_bytes_rmx;
+
+	return g_scfg.write_reqs_per_sec * factor *
+			(g_scfg.record_bytes + record_bytes_max) / 2.0;
+}
+
 static inline uint64_t
 random_large_block_offset(const device* dev)
 {
@@ -170,6 +479,55 @@ random_read_offset(const device* dev)
 	return (rand_64() % dev->n_read_offsets) * dev->min_op_bytes;
 }
 
+// Pick a read offset in a recently written large block - the age of the
+// block, in writes, is geometrically distributed with the configured half-life.
+// Caller makes sure the device has written at least one block.
+static inline uint64_t
+random_recent_read_offset(device* dev)
+{
+	uint64_t n_writes = atomic64_get(dev->n_recent_writes);
+	uint64_t n_recent = n_writes < g_scfg.recent_ring_size ?
+			n_writes : g_scfg.recent_ring_size;
+
+	// Uniform in (0, 1], so log2() is finite.
+	double u = ((double)rand_32() + 1.0) / 4294967296.0;
+	uint64_t age = (uint64_t)(-log2(u) * g_scfg.recent_read_half_life) %
+			n_recent;
+	uint64_t block_offset =
+			dev->recent_offsets[(n_writes - 1 - age) % g_scfg.recent_ring_size];
+
+	// Leave room in the block for the largest read.
+	uint32_t n_slots = (g_scfg.large_block_ops_bytes - dev->read_bytes) /
+			dev->min_op_bytes - (dev->n_read_sizes - 1) + 1;
+
+	return block_offset + ((rand_32() % n_slots) * dev->min_op_bytes);
+}
+
+// Pick a device for a record read or write, by its share of the stream.
+static inline device*
+random_req_device(bool is_write)
+{
+	if (! g_scfg.per_device_rates) {
+		return &g_devices[rand_32() % g_scfg.num_data_devices];
+	}
+
+	double u = (double)rand_32() / 4294967296.0;
+	uint32_t last = g_scfg.num_data_devices - 1;
+
+	for (uint32_t d = 0; d < last; d++) {
+		double share = is_write ?
+				g_devices[d].write_share : g_devices[d].read_share;
+
+		if (u < share) {
+			return &g_devices[d];
+		}
+
+		u -= share;
+	}
+
+	return &g_devices[last];
+}
+
 static inline uint32_t
 random_read_size(const device* dev)
 {
@@ -204,6 +562,79 @@ safe_delta_ns(uint64_t start_ns, uint64_t stop_ns)
 	return start_ns > stop_ns ? 0 : stop_ns - start_ns;
 }
 
+// Remember a large-block write for recent reads - lock-free, slots are claimed
+// by counting and a read may rarely see a slot's previous offset.
+static inline void
+record_recent_write(device* dev, uint64_t offset)
+{
+	if (dev->recent_offsets != NULL) {
+		uint64_t n = (uint64_t)atomic64_incr(&dev->n_recent_writes);
+
+		dev->recent_offsets[(n - 1) % g_scfg.recent_ring_size] = offset;
+	}
+}
+
+// Add a device IO's latency to its thread's IO priority histogram, if any.
+static inline uint64_t
+report_ioprio(uint64_t start_ns, uint64_t stop_ns)
+{
+	if (tl_ioprio_hist != NULL) {
+		histogram_insert_data_point(tl_ioprio_hist,
+				safe_delta_ns(start_ns, stop_ns));
+	}
+
+	return stop_ns;
+}
+
+// Expected bytes per second of partial-block flushes at the configured load,
+// ignoring rounding up to IO size. Flush k of a block rewrites the k flush
+// intervals' worth of data it holds so far.
+static inline double
+partial_flush_bytes_per_sec()
+{
+	if (g_scfg.flush_max_us == 0 || g_scfg.large_block_writes_per_sec == 0) {
+		return 0.0;
+	}
+
+	double block_bytes = (double)g_scfg.large_block_ops_bytes;
+	double fill_bps = g_scfg.large_block_writes_per_sec * block_bytes;
+	double per_flush = fill_bps / g_scfg.num_data_devices *
+			(g_scfg.flush_max_us / 1000000.0);
+
+	// Partial flushes per block - none if it fills within flush-max-ms.
+	double n = per_flush >= block_bytes ? 0.0 :
+			ceil(block_bytes / per_flush) - 1.0;
+
+	return (fill_bps / block_bytes) * per_flush * (n * (n + 1.0) / 2.0);
+}
+
+// Total bytes the data device(s) can hold, for drive-writes-per-day. Also
+// what shadow devices hold, since they mirror the same offsets.
+static inline uint64_t
+total_device_bytes()
+{
+	uint64_t total = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+		total += g_devices[d].n_large_blocks * g_scfg.large_block_ops_bytes;
+	}
+
+	return total;
+}
+
+// Total bytes the index device(s) can hold, for drive-writes-per-day.
+static inline uint64_t
+total_index_device_bytes()
+{
+	uint64_t total = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_index_devices; d++) {
+		total += g_index_devices[d].n_read_offsets * INDEX_IO_SIZE;
+	}
+
+	return total;
+}
+
 
 //==========================================================
 // Main.
@@ -222,10 +653,12 @@ main(int argc, char* argv[])
 		exit(-1);
 	}
 
-	device devices[g_scfg.num_devices];
+	device devices[g_scfg.num_data_devices];
+	device index_devices[g_scfg.num_index_devices];
 	queue* trans_qs[g_scfg.num_queues];
 
 	g_devices = devices;
+	g_index_devices = index_devices;
 	g_trans_qs = trans_qs;
 
 	histogram_scale scale =
@@ -236,20 +669,101 @@ main(int argc, char* argv[])
 		! (g_raw_read_hist = histogram_create(scale)) ||
 		! (g_read_hist = histogram_create(scale)) ||
 		! (g_raw_write_hist = histogram_create(scale)) ||
-		! (g_write_hist = histogram_create(scale))) {
+		! (g_write_hist = histogram_create(scale)) ||
+		! (g_lag_read_hist = histogram_create(scale)) ||
+		! (g_lag_write_hist = histogram_create(scale)) ||
+		! (g_lag_large_block_read_hist = histogram_create(scale)) ||
+		! (g_lag_large_block_write_hist = histogram_create(scale)) ||
+		! (g_chunk_large_block_read_hist = histogram_create(scale)) ||
+		! (g_chunk_large_block_write_hist = histogram_create(scale)) ||
+		! (g_cache_hit_read_hist = histogram_create(scale)) ||
+		! (g_cache_miss_read_hist = histogram_create(scale)) ||
+		! (g_recent_read_hist = histogram_create(scale)) ||
+		! (g_cold_read_hist = histogram_create(scale)) ||
+		! (g_handoff_hist = histogram_create(scale)) ||
+		! (g_partial_flush_write_hist = histogram_create(scale)) ||
+		! (g_shadow_write_hist = histogram_create(scale)) ||
+		! (g_index_read_hist = histogram_create(scale)) ||
+		! (g_index_write_hist = histogram_create(scale)) ||
+		! (g_lag_index_cache_hist = histogram_create(scale))) {
+		exit(-1);
+	}
+
+	if (! (g_cpu_generators = cpu_group_create("generators",
+			g_scfg.read_req_threads + g_scfg.write_req_threads)) ||
+		! (g_cpu_index_cache = cpu_group_create("index-cache",
+			g_scfg.cache_threads)) ||
+		! (g_cpu_large_block = cpu_group_create("large-block",
+			g_scfg.num_data_devices * ((2 * g_scfg.large_block_threads) +
+					(g_scfg.flush_max_us != 0 ? 1 : 0)))) ||
+		! (g_cpu_shadow = cpu_group_create("shadow", g_scfg.num_shadows)) ||
+		! (g_cpu_tomb_raider = cpu_group_create("tomb-raider",
+			g_scfg.num_data_devices)) ||
+		! (g_cpu_transactions = cpu_group_create("transactions",
+			g_scfg.num_queues * max_threads_per_queue()))) {
 		exit(-1);
 	}
 
+	if (g_scfg.perf_counters) {
+		perf_probe();
+
+		if (! (g_perf_generators = perf_group_create("generators",
+				g_scfg.read_req_threads + g_scfg.write_req_threads)) ||
+			! (g_perf_transactions = perf_group_create("transactions",
+				g_scfg.num_queues * max_threads_per_queue()))) {
+			exit(-1);
+		}
+	}
+
+	uint32_t n_data = 0;
+	uint32_t n_index = 0;
+
 	for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
-		device* dev = &g_devices[n];
+		const char* name = (const char*)g_scfg.device_names[n];
+		device_role role = g_scfg.device_roles[n];
+
+		if (g_scfg.file_size == 0 && ! g_scfg.pmem) { // normally true
+			set_scheduler(name, g_scfg.scheduler_mode);
+		}
 
-		dev->name = (const char*)g_scfg.device_names[n];
+		if (role != DEVICE_ROLE_DATA) {
+			device* dev = &g_index_devices[n_index++];
 
-		if (g_scfg.file_size == 0) { // normally 0
-			set_scheduler(dev->name, g_scfg.scheduler_mode);
+			dev->name = name;
+
+			if (! (dev->read_fd_q = queue_create(sizeof(int), true)) ||
+				! (dev->write_fd_q = queue_create(sizeof(int), true)) ||
+				! discover_index_device(dev)) {
+				exit(-1);
+			}
+
+			// A device with both roles reports its stats as a data device.
+			if (role == DEVICE_ROLE_INDEX) {
+				disk_stats_init(dev->name, &dev->stats);
+			}
+			else {
+				memset(&dev->stats, 0, sizeof(disk_stats));
+			}
+		}
+
+		if (role == DEVICE_ROLE_INDEX) {
+			continue;
 		}
 
-		if (! (dev->fd_q = queue_create(sizeof(int), true)) ||
+		device* dev = &g_devices[n_data];
+
+		dev->name = name;
+		dev->record_stored_bytes = g_scfg.device_record_stored_bytes[n];
+		dev->record_stored_bytes_rmx = g_scfg.device_record_stored_bytes_rmx[n];
+		dev->read_share = g_scfg.device_read_shares[n];
+		dev->write_share = g_scfg.device_write_shares[n];
+		dev->large_block_share = g_scfg.device_large_block_shares[n];
+		dev->n_large_block_reads = 0;
+		dev->n_large_block_writes = 0;
+		memset(&dev->last_counts, 0, sizeof(device_counts));
+
+		if (! (dev->read_fd_q = queue_create(sizeof(int), true)) ||
+			! (dev->write_fd_q = queue_create(sizeof(int), true)) ||
 			! discover_device(dev) ||
 			! (dev->raw_read_hist = histogram_create(scale)) ||
 			! (dev->raw_write_hist = histogram_create(scale))) {
@@ -258,10 +772,72 @@ main(int argc, char* argv[])
 
 		sprintf(dev->read_hist_tag, "%s-reads", dev->name);
 		sprintf(dev->write_hist_tag, "%s-writes", dev->name);
+
+		disk_stats_init(dev->name, &dev->stats);
+
+		dev->n_recent_writes = 0;
+		dev->recent_offsets = NULL;
+
+		if (g_scfg.recent_read_pct != 0 &&
+				! (dev->recent_offsets = calloc(g_scfg.recent_ring_size,
+						sizeof(uint64_t)))) {
+			fprintf(stdout, "ERROR: recent writes ring calloc()\n");
+			exit(-1);
+		}
+
+		if (g_scfg.num_shadows != 0) {
+			dev->shadow_name = (const char*)g_scfg.shadow_names[n_data];
+
+			if (g_scfg.file_size == 0) {
+				set_scheduler(dev->shadow_name, g_scfg.scheduler_mode);
+			}
+
+			if (! (dev->shadow_q = queue_create(sizeof(uint64_t), true)) ||
+				! discover_shadow(dev)) {
+				exit(-1);
+			}
+		}
+
+		n_data++;
+	}
+
+	if (g_scfg.pmem) {
+		pmem_probe();
+	}
+
+	if (g_scfg.transaction_ioprio != 0 || g_scfg.large_block_ioprio != 0 ||
+			g_scfg.tomb_raider_ioprio != 0 || g_scfg.cache_ioprio != 0) {
+		int ioprios[] = {
+				g_scfg.transaction_ioprio,
+				g_scfg.write_reqs_per_sec != 0 ? g_scfg.large_block_ioprio : -1,
+				g_scfg.tomb_raider ? g_scfg.tomb_raider_ioprio : -1,
+				g_scfg.index_cache_ops_per_sec != 0 ? g_scfg.cache_ioprio : -1
+		};
+
+		// Fail up front if we aren't allowed a priority, e.g. rt.
+		for (uint32_t i = 0; i < N_IOPRIO_STREAMS; i++) {
+			if (ioprios[i] != -1) {
+				if (! ioprio_set_self(ioprios[i])) {
+					exit(-1);
+				}
+
+				add_ioprio_hist(ioprios[i], scale);
+			}
+		}
+
+		ioprio_set_self(0);
 	}
 
 	rand_seed();
 
+	if (g_scfg.file_drop_cache) {
+		drop_page_cache();
+	}
+
+	if (g_scfg.num_load_steps != 0) {
+		g_load_factor = g_scfg.load_multipliers[0];
+	}
+
 	g_run_start_us = get_us();
 
 	uint64_t run_stop_us = g_run_start_us + g_scfg.run_us;
@@ -269,25 +845,53 @@ main(int argc, char* argv[])
 	g_running = true;
 
 	if (g_scfg.write_reqs_per_sec != 0) {
-		for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
+		for (uint32_t n = 0; n < g_scfg.num_data_devices; n++) {
 			device* dev = &g_devices[n];
 
-			if (pthread_create(&dev->large_block_read_thread, NULL,
-					run_large_block_reads, (void*)dev) != 0) {
+			if (! start_large_block_stream(dev, &dev->large_block_reads,
+					g_scfg.large_block_reads_per_sec, run_large_block_reads)) {
 				fprintf(stdout, "ERROR: create large op read thread\n");
 				exit(-1);
 			}
 
-			if (pthread_create(&dev->large_block_write_thread, NULL,
-					run_large_block_writes, (void*)dev) != 0) {
+			if (! start_large_block_stream(dev, &dev->large_block_writes,
+					g_scfg.large_block_writes_per_sec,
+					run_large_block_writes)) {
 				fprintf(stdout, "ERROR: create large op write thread\n");
 				exit(-1);
 			}
+
+			if (g_scfg.flush_max_us != 0) {
+				if (pthread_create(&dev->partial_flush_thread, NULL,
+						run_partial_flushes, (void*)dev) != 0) {
+					fprintf(stdout, "ERROR: create partial flush thread\n");
+					exit(-1);
+				}
+
+				if (! cpu_group_add(g_cpu_large_block,
+						dev->partial_flush_thread)) {
+					exit(-1);
+				}
+			}
+
+			if (g_scfg.num_shadows == 0) {
+				continue;
+			}
+
+			if (pthread_create(&dev->shadow_thread, NULL,
+					run_shadow_writes, (void*)dev) != 0) {
+				fprintf(stdout, "ERROR: create shadow write thread\n");
+				exit(-1);
+			}
+
+			if (! cpu_group_add(g_cpu_shadow, dev->shadow_thread)) {
+				exit(-1);
+			}
 		}
 	}
 
 	if (g_scfg.tomb_raider) {
-		for (uint32_t n = 0; n < g_scfg.num_devices; n++) {
+		for (uint32_t n = 0; n < g_scfg.num_data_devices; n++) {
 			device* dev = &g_devices[n];
 
 			if (pthread_create(&dev->tomb_raider_thread, NULL,
@@ -295,23 +899,43 @@ main(int argc, char* argv[])
 				fprintf(stdout, "ERROR: create tomb raider thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_tomb_raider, dev->tomb_raider_thread)) {
+				exit(-1);
+			}
 		}
 	}
 
-	uint32_t n_trans_tids = g_scfg.num_queues * g_scfg.threads_per_queue;
+	// Start the most threads we may need - any beyond the active count park.
+	uint32_t threads_per_queue = max_threads_per_queue();
+	uint32_t n_trans_tids = g_scfg.num_queues * threads_per_queue;
 	pthread_t trans_tids[n_trans_tids];
 
+	atomic32_set(&g_trans_threads_active, g_scfg.threads_per_queue);
+
+	// Create all queues first - with work stealing, threads use any queue.
 	for (uint32_t i = 0; i < g_scfg.num_queues; i++) {
 		if (! (g_trans_qs[i] = queue_create(sizeof(trans_req), true))) {
 			exit(-1);
 		}
 
-		for (uint32_t j = 0; j < g_scfg.threads_per_queue; j++) {
-			if (pthread_create(&trans_tids[(i * g_scfg.threads_per_queue) + j],
-					NULL, run_transactions, (void*)g_trans_qs[i]) != 0) {
+		queue_set_wait(g_trans_qs[i], g_scfg.queue_park, g_scfg.queue_spin_us);
+	}
+
+	for (uint32_t i = 0; i < g_scfg.num_queues; i++) {
+		for (uint32_t j = 0; j < threads_per_queue; j++) {
+			uint32_t n = (i * threads_per_queue) + j;
+			pthread_t* p_tid = &trans_tids[n];
+
+			if (pthread_create(p_tid, NULL, run_transactions,
+					(void*)(uintptr_t)n) != 0) {
 				fprintf(stdout, "ERROR: create transaction thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_transactions, *p_tid)) {
+				exit(-1);
+			}
 		}
 	}
 
@@ -327,6 +951,28 @@ main(int argc, char* argv[])
 				fprintf(stdout, "ERROR: create read request thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_generators, read_req_tids[k])) {
+				exit(-1);
+			}
+		}
+	}
+
+	bool do_index_cache = g_scfg.index_cache_ops_per_sec != 0;
+
+	pthread_t cache_tids[g_scfg.cache_threads];
+
+	if (do_index_cache) {
+		for (uint32_t k = 0; k < g_scfg.cache_threads; k++) {
+			if (pthread_create(&cache_tids[k], NULL, run_index_cache,
+					NULL) != 0) {
+				fprintf(stdout, "ERROR: create index cache thread\n");
+				exit(-1);
+			}
+
+			if (! cpu_group_add(g_cpu_index_cache, cache_tids[k])) {
+				exit(-1);
+			}
 		}
 	}
 
@@ -342,32 +988,84 @@ main(int argc, char* argv[])
 				fprintf(stdout, "ERROR: create write request thread\n");
 				exit(-1);
 			}
+
+			if (! cpu_group_add(g_cpu_generators, write_req_tids[k])) {
+				exit(-1);
+			}
 		}
 	}
 
+	if (g_scfg.write_reqs_per_sec != 0) {
+		report_endurance_projection();
+	}
+
 	fprintf(stdout, "\nHISTOGRAM NAMES\n");
 
 	if (do_reads) {
 		fprintf(stdout, "reads\n");
 		fprintf(stdout, "device-reads\n");
 
-		for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
 			fprintf(stdout, "%s\n", g_devices[d].read_hist_tag);
 		}
+
+		fprintf(stdout, "lag-reads\n");
+
+		if (buffered_io()) {
+			fprintf(stdout, "cache-hit-reads\n");
+			fprintf(stdout, "cache-miss-reads\n");
+		}
+
+		if (g_scfg.recent_read_pct != 0) {
+			fprintf(stdout, "recent-reads\n");
+			fprintf(stdout, "cold-reads\n");
+		}
+	}
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, "index-device-reads\n");
+
+		if (do_index_cache) {
+			fprintf(stdout, "index-device-writes\n");
+			fprintf(stdout, "lag-index-cache-ops\n");
+		}
 	}
 
 	if (g_scfg.write_reqs_per_sec != 0) {
 		fprintf(stdout, "large-block-reads\n");
 		fprintf(stdout, "large-block-writes\n");
+		fprintf(stdout, "lag-large-block-reads\n");
+		fprintf(stdout, "lag-large-block-writes\n");
+
+		if (g_scfg.large_block_chunk_bytes != 0) {
+			fprintf(stdout, "chunk-large-block-reads\n");
+			fprintf(stdout, "chunk-large-block-writes\n");
+		}
+
+		if (g_scfg.flush_max_us != 0) {
+			fprintf(stdout, "partial-flush-writes\n");
+		}
+
+		if (g_scfg.num_shadows != 0) {
+			fprintf(stdout, "shadow-large-block-writes\n");
+		}
 	}
 
 	if (do_commits) {
 		fprintf(stdout, "writes\n");
 		fprintf(stdout, "device-writes\n");
 
-		for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
 			fprintf(stdout, "%s\n", g_devices[d].write_hist_tag);
 		}
+
+		fprintf(stdout, "lag-writes\n");
+	}
+
+	fprintf(stdout, "queue-handoffs\n");
+
+	for (uint32_t i = 0; i < g_num_ioprio_hists; i++) {
+		fprintf(stdout, "%s\n", g_ioprio_hists[i].tag);
 	}
 
 	fprintf(stdout, "\n");
@@ -392,37 +1090,155 @@ main(int argc, char* argv[])
 		fprintf(stdout, "requests-queued: %" PRIu32 "\n",
 				atomic32_get(g_reqs_queued));
 
+		report_rates();
+
+		report_generator_lag();
+
+		if (g_scfg.work_stealing) {
+			report_steals();
+		}
+
+		if (g_scfg.threads_per_queue_max != 0) {
+			adjust_trans_threads();
+		}
+
+		if (g_scfg.write_reqs_per_sec != 0) {
+			report_write_bytes();
+
+			if (g_scfg.num_shadows != 0) {
+				report_shadow_backlog();
+			}
+		}
+
+		report_cpu();
+
+		if (g_scfg.perf_counters) {
+			report_perf();
+		}
+
+		if (g_scfg.pmem) {
+			report_pmem_bytes();
+		}
+
+		for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+			disk_stats_report(g_devices[d].name, &g_devices[d].stats);
+		}
+
+		for (uint32_t d = 0; d < g_scfg.num_index_devices; d++) {
+			disk_stats_report(g_index_devices[d].name,
+					&g_index_devices[d].stats);
+		}
+
+		if (g_scfg.on_overload != OVERLOAD_STOP) {
+			report_overload();
+		}
+
 		if (do_reads) {
 			histogram_dump(g_read_hist, "reads");
 			histogram_dump(g_raw_read_hist, "device-reads");
 
-			for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+			for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
 				histogram_dump(g_devices[d].raw_read_hist,
 						g_devices[d].read_hist_tag);
 			}
+
+			histogram_dump(g_lag_read_hist, "lag-reads");
+
+			if (buffered_io()) {
+				histogram_dump(g_cache_hit_read_hist, "cache-hit-reads");
+				histogram_dump(g_cache_miss_read_hist, "cache-miss-reads");
+			}
+
+			if (g_scfg.recent_read_pct != 0) {
+				histogram_dump(g_recent_read_hist, "recent-reads");
+				histogram_dump(g_cold_read_hist, "cold-reads");
+			}
+		}
+
+		if (g_scfg.num_index_devices != 0) {
+			histogram_dump(g_index_read_hist, "index-device-reads");
+
+			if (do_index_cache) {
+				histogram_dump(g_index_write_hist, "index-device-writes");
+				histogram_dump(g_lag_index_cache_hist, "lag-index-cache-ops");
+			}
 		}
 
 		if (g_scfg.write_reqs_per_sec != 0) {
 			histogram_dump(g_large_block_read_hist, "large-block-reads");
 			histogram_dump(g_large_block_write_hist, "large-block-writes");
+			histogram_dump(g_lag_large_block_read_hist,
+					"lag-large-block-reads");
+			histogram_dump(g_lag_large_block_write_hist,
+					"lag-large-block-writes");
+
+			if (g_scfg.large_block_chunk_bytes != 0) {
+				histogram_dump(g_chunk_large_block_read_hist,
+						"chunk-large-block-reads");
+				histogram_dump(g_chunk_large_block_write_hist,
+						"chunk-large-block-writes");
+			}
+
+			if (g_scfg.flush_max_us != 0) {
+				histogram_dump(g_partial_flush_write_hist,
+						"partial-flush-writes");
+			}
+
+			if (g_scfg.num_shadows != 0) {
+				histogram_dump(g_shadow_write_hist,
+						"shadow-large-block-writes");
+			}
 		}
 
 		if (do_commits) {
 			histogram_dump(g_write_hist, "writes");
 			histogram_dump(g_raw_write_hist, "device-writes");
 
-			for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+			for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
 				histogram_dump(g_devices[d].raw_write_hist,
 						g_devices[d].write_hist_tag);
 			}
+
+			histogram_dump(g_lag_write_hist, "lag-writes");
+		}
+
+		histogram_dump(g_handoff_hist, "queue-handoffs");
+
+		for (uint32_t i = 0; i < g_num_ioprio_hists; i++) {
+			histogram_dump(g_ioprio_hists[i].hist, g_ioprio_hists[i].tag);
 		}
 
 		fprintf(stdout, "\n");
+
+		if (g_scfg.num_load_steps != 0 &&
+				(count * g_scfg.report_interval_us) % g_scfg.load_step_us == 0) {
+			end_load_step(g_scfg.load_step_us);
+		}
+
 		fflush(stdout);
 	}
 
 	g_running = false;
 
+	if (g_scfg.threads_per_queue_max != 0) {
+		fprintf(stdout, "adaptive pool settled on threads-per-queue: %" PRIu32
+				" (use for fixed runs)\n",
+				atomic32_get(g_trans_threads_active));
+	}
+
+	if (g_scfg.num_load_steps != 0) {
+		uint64_t step_start_us = g_num_steps_done * g_scfg.load_step_us;
+		uint64_t run_us = get_us() - g_run_start_us;
+
+		// Include a partial step if the test stopped early.
+		if (g_num_steps_done < g_scfg.num_load_steps &&
+				run_us > step_start_us) {
+			end_load_step(run_us - step_start_us);
+		}
+
+		report_load_steps();
+	}
+
 	if (do_reads) {
 		for (uint32_t k = 0; k < g_scfg.read_req_threads; k++) {
 			pthread_join(read_req_tids[k], NULL);
@@ -435,6 +1251,12 @@ main(int argc, char* argv[])
 		}
 	}
 
+	if (do_index_cache) {
+		for (uint32_t k = 0; k < g_scfg.cache_threads; k++) {
+			pthread_join(cache_tids[k], NULL);
+		}
+	}
+
 	for (uint32_t j = 0; j < n_trans_tids; j++) {
 		pthread_join(trans_tids[j], NULL);
 	}
@@ -443,7 +1265,7 @@ main(int argc, char* argv[])
 		queue_destroy(g_trans_qs[i]);
 	}
 
-	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
 		device* dev = &g_devices[d];
 
 		if (g_scfg.tomb_raider) {
@@ -451,22 +1273,81 @@ main(int argc, char* argv[])
 		}
 
 		if (g_scfg.write_reqs_per_sec != 0) {
-			pthread_join(dev->large_block_read_thread, NULL);
-			pthread_join(dev->large_block_write_thread, NULL);
+			stop_large_block_stream(&dev->large_block_reads);
+			stop_large_block_stream(&dev->large_block_writes);
+
+			if (g_scfg.flush_max_us != 0) {
+				pthread_join(dev->partial_flush_thread, NULL);
+			}
+
+			if (g_scfg.num_shadows != 0) {
+				pthread_join(dev->shadow_thread, NULL);
+			}
+		}
+
+		if (g_scfg.num_shadows != 0) {
+			close(dev->shadow_fd);
+			queue_destroy(dev->shadow_q);
+		}
+
+		if (g_scfg.pmem) {
+			pmem_unmap(dev->pmem_base, dev->pmem_bytes);
 		}
 
 		fd_close_all(dev);
-		queue_destroy(dev->fd_q);
+		queue_destroy(dev->read_fd_q);
+		queue_destroy(dev->write_fd_q);
 		free(dev->raw_read_hist);
 		free(dev->raw_write_hist);
+		free(dev->recent_offsets);
 	}
 
-	free(g_large_block_read_hist);
+	for (uint32_t d = 0; d < g_scfg.num_index_devices; d++) {
+		device* dev = &g_index_devices[d];
+
+		fd_close_all(dev);
+		queue_destroy(dev->read_fd_q);
+		queue_destroy(dev->write_fd_q);
+	}
+
+	free(g_large_block_read_hist);
 	free(g_large_block_write_hist);
 	free(g_raw_read_hist);
 	free(g_read_hist);
 	free(g_raw_write_hist);
 	free(g_write_hist);
+	free(g_lag_read_hist);
+	free(g_lag_write_hist);
+	free(g_lag_large_block_read_hist);
+	free(g_lag_large_block_write_hist);
+	free(g_chunk_large_block_read_hist);
+	free(g_chunk_large_block_write_hist);
+	free(g_cache_hit_read_hist);
+	free(g_cache_miss_read_hist);
+	free(g_recent_read_hist);
+	free(g_cold_read_hist);
+	free(g_handoff_hist);
+	free(g_partial_flush_write_hist);
+	free(g_shadow_write_hist);
+	free(g_index_read_hist);
+	free(g_index_write_hist);
+	free(g_lag_index_cache_hist);
+
+	for (uint32_t i = 0; i < g_num_ioprio_hists; i++) {
+		free(g_ioprio_hists[i].hist);
+	}
+
+	free(g_cpu_generators);
+	free(g_cpu_index_cache);
+	free(g_cpu_large_block);
+	free(g_cpu_shadow);
+	free(g_cpu_tomb_raider);
+	free(g_cpu_transactions);
+
+	if (g_scfg.perf_counters) {
+		perf_group_destroy(g_perf_generators);
+		perf_group_destroy(g_perf_transactions);
+	}
 
 	return 0;
 }
@@ -484,44 +1365,64 @@ main(int argc, char* argv[])
 static void*
 run_generate_read_reqs(void* pv_unused)
 {
+	if (g_scfg.perf_counters) {
+		perf_group_add_self(g_perf_generators);
+	}
+
 	rand_seed_thread();
 
-	uint64_t count = 0;
-	uint64_t internal_read_reqs_per_sec =
-			g_scfg.internal_read_reqs_per_sec / g_scfg.read_req_threads;
+	pacer pace;
+
+	pacer_init(&pace, g_run_start_us,
+			(double)g_scfg.internal_read_reqs_per_sec / g_scfg.read_req_threads,
+			load_factor());
 
 	while (g_running) {
 		if (atomic32_incr(&g_reqs_queued) > g_scfg.max_reqs_queued) {
-			fprintf(stdout, "ERROR: too many requests queued\n");
-			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
-			g_running = false;
-			break;
+			if (! shed_req()) {
+				fprintf(stdout, "ERROR: too many requests queued\n");
+				fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+				g_running = false;
+				break;
+			}
+		}
+		else {
+			uint32_t q_index = pace.count % g_scfg.num_queues;
+			device* random_dev = random_req_device(false);
+			bool is_recent = g_scfg.recent_read_pct != 0 &&
+					rand_32() % 100 < g_scfg.recent_read_pct &&
+					atomic64_get(random_dev->n_recent_writes) != 0;
+
+			trans_req read_req = {
+					.dev = random_dev,
+					.offset = is_recent ?
+							random_recent_read_offset(random_dev) :
+							random_read_offset(random_dev),
+					.size = random_read_size(random_dev),
+					.is_write = false,
+					.is_recent = is_recent,
+					.start_time = get_ns()
+			};
+
+			histogram_insert_data_point(g_lag_read_hist,
+					pacer_lag_us(&pace) * 1000);
+
+			queue_push(g_trans_qs[q_index], &read_req);
+			cpu_group_count(g_cpu_generators, 1, read_req.size);
 		}
 
-		uint32_t q_index = count % g_scfg.num_queues;
-		uint32_t random_dev_index = rand_32() % g_scfg.num_devices;
-		device* random_dev = &g_devices[random_dev_index];
-
-		trans_req read_req = {
-				.dev = random_dev,
-				.offset = random_read_offset(random_dev),
-				.size = random_read_size(random_dev),
-				.is_write = false,
-				.start_time = get_ns()
-		};
-
-		queue_push(g_trans_qs[q_index], &read_req);
-
-		count++;
+		int64_t sleep_us = pacer_next_sleep_us(&pace, 1, load_factor());
 
-		int64_t sleep_us = (int64_t)
-				(((count * 1000000) / internal_read_reqs_per_sec) -
-						(get_us() - g_run_start_us));
+		if (sleep_us < 0) {
+			atomic64_incr(&g_reqs_late);
+			note_generator_lag(sleep_us);
+		}
 
 		if (sleep_us > 0) {
 			usleep((uint32_t)sleep_us);
 		}
-		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec) {
+		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec &&
+				! shed_lag(&pace, &g_reqs_shed)) {
 			fprintf(stdout, "ERROR: read request generator can't keep up\n");
 			fprintf(stdout, "ACT can't do requested load - test stopped\n");
 			fprintf(stdout, "try configuring more 'service-threads'\n");
@@ -540,47 +1441,125 @@ run_generate_read_reqs(void* pv_unused)
 static void*
 run_generate_write_reqs(void* pv_unused)
 {
+	if (g_scfg.perf_counters) {
+		perf_group_add_self(g_perf_generators);
+	}
+
 	rand_seed_thread();
 
-	uint64_t count = 0;
-	uint64_t internal_write_reqs_per_sec =
-			g_scfg.internal_write_reqs_per_sec / g_scfg.write_req_threads;
+	pacer pace;
+
+	pacer_init(&pace, g_run_start_us,
+			(double)g_scfg.internal_write_reqs_per_sec / g_scfg.write_req_threads,
+			load_factor());
 
 	while (g_running) {
 		if (atomic32_incr(&g_reqs_queued) > g_scfg.max_reqs_queued) {
-			fprintf(stdout, "ERROR: too many requests queued\n");
-			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+			if (! shed_req()) {
+				fprintf(stdout, "ERROR: too many requests queued\n");
+				fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+				g_running = false;
+				break;
+			}
+		}
+		else {
+			uint32_t q_index = pace.count % g_scfg.num_queues;
+			device* random_dev = random_req_device(true);
+
+			trans_req write_req = {
+					.dev = random_dev,
+					.offset = random_write_offset(random_dev),
+					.size = random_write_size(random_dev),
+					.is_write = true,
+					.start_time = get_ns()
+			};
+
+			histogram_insert_data_point(g_lag_write_hist,
+					pacer_lag_us(&pace) * 1000);
+
+			queue_push(g_trans_qs[q_index], &write_req);
+			cpu_group_count(g_cpu_generators, 1, write_req.size);
+		}
+
+		int64_t sleep_us = pacer_next_sleep_us(&pace, 1, load_factor());
+
+		if (sleep_us < 0) {
+			atomic64_incr(&g_reqs_late);
+			note_generator_lag(sleep_us);
+		}
+
+		if (sleep_us > 0) {
+			usleep((uint32_t)sleep_us);
+		}
+		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec &&
+				! shed_lag(&pace, &g_reqs_shed)) {
+			fprintf(stdout, "ERROR: write request generator can't keep up\n");
+			fprintf(stdout, "ACT can't do requested load - test stopped\n");
+			fprintf(stdout, "try configuring more 'service-threads'\n");
 			g_running = false;
-			break;
 		}
+	}
+
+	return NULL;
+}
 
-		uint32_t q_index = count % g_scfg.num_queues;
-		uint32_t random_dev_index = rand_32() % g_scfg.num_devices;
-		device* random_dev = &g_devices[random_dev_index];
+//------------------------------------------------
+// Runs in every index cache thread, modeling the
+// threads which write back index changes (and do
+// index defrag reads) behind mmap - see act_index.
+//
+static void*
+run_index_cache(void* pv_unused)
+{
+	rand_seed_thread();
 
-		trans_req write_req = {
-				.dev = random_dev,
-				.offset = random_write_offset(random_dev),
-				.size = random_write_size(random_dev),
-				.is_write = true,
-				.start_time = get_ns()
-		};
+	set_thread_ioprio(g_scfg.cache_ioprio);
 
-		queue_push(g_trans_qs[q_index], &write_req);
+	uint8_t stack_buffer[INDEX_IO_SIZE + 4096];
+	uint8_t* buf = align_4096(stack_buffer);
 
-		count++;
+	pacer pace;
 
-		int64_t sleep_us = (int64_t)
-				(((count * 1000000) / internal_write_reqs_per_sec) -
-						(get_us() - g_run_start_us));
+	pacer_init(&pace, g_run_start_us,
+			g_scfg.index_cache_ops_per_sec / g_scfg.cache_threads,
+			load_factor());
+
+	while (g_running) {
+		histogram_insert_data_point(g_lag_index_cache_hist,
+				pacer_lag_us(&pace) * 1000);
+
+		read_index_and_report(buf);
+
+		// Salt the buffer each time.
+		rand_fill(buf, INDEX_IO_SIZE);
+
+		device* dev = &g_index_devices[rand_32() % g_scfg.num_index_devices];
+		uint64_t start_time = get_ns();
+		uint64_t stop_time = write_to_device(dev, random_read_offset(dev),
+				INDEX_IO_SIZE, buf);
+
+		if (stop_time != -1) {
+			histogram_insert_data_point(g_index_write_hist,
+					safe_delta_ns(start_time, stop_time));
+			atomic64_add(&g_index_write_bytes, INDEX_IO_SIZE);
+		}
+
+		// Each cache op is a device read and a device write.
+		cpu_group_count(g_cpu_index_cache, 2, 2 * INDEX_IO_SIZE);
+
+		int64_t sleep_us = pacer_next_sleep_us(&pace, 1, load_factor());
+
+		if (sleep_us < 0) {
+			atomic64_incr(&g_index_cache_ops_late);
+		}
 
 		if (sleep_us > 0) {
 			usleep((uint32_t)sleep_us);
 		}
-		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec) {
-			fprintf(stdout, "ERROR: write request generator can't keep up\n");
-			fprintf(stdout, "ACT can't do requested load - test stopped\n");
-			fprintf(stdout, "try configuring more 'service-threads'\n");
+		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec &&
+				! shed_lag(&pace, &g_index_cache_ops_shed)) {
+			fprintf(stdout, "ERROR: index cache device IO can't keep up\n");
+			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
 			g_running = false;
 		}
 	}
@@ -590,13 +1569,16 @@ run_generate_write_reqs(void* pv_unused)
 
 //------------------------------------------------
 // Runs in every device large-block read thread,
-// executes large-block reads at a constant rate.
+// executes its share of the device's large-block
+// reads at a constant rate.
 //
 static void*
 run_large_block_reads(void* pv_dev)
 {
 	rand_seed_thread();
 
+	set_thread_ioprio(g_scfg.large_block_ioprio);
+
 	device* dev = (device*)pv_dev;
 
 	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
@@ -607,27 +1589,87 @@ run_large_block_reads(void* pv_dev)
 		return NULL;
 	}
 
-	uint64_t count = 0;
+	if (parallel_chunks() && ! async_io_setup(g_scfg.large_block_ops_bytes /
+			g_scfg.large_block_chunk_bytes, &tl_aio_ctx)) {
+		free(buf);
+		g_running = false;
+		return NULL;
+	}
 
 	while (g_running) {
+		if (! pace_large_block_op(&dev->large_block_reads,
+				g_lag_large_block_read_hist)) {
+			fprintf(stdout, "ERROR: large block reads can't keep up\n");
+			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+			g_running = false;
+			break;
+		}
+
+		if (! g_running) {
+			break;
+		}
+
 		read_and_report_large_block(dev, buf);
+		cpu_group_count(g_cpu_large_block, 1, g_scfg.large_block_ops_bytes);
+	}
 
-		count++;
+	if (parallel_chunks()) {
+		async_io_destroy(tl_aio_ctx);
+	}
 
-		uint64_t target_us = (uint64_t)
-				((double)(count * 1000000 * g_scfg.num_devices) /
-						g_scfg.large_block_reads_per_sec);
+	free(buf);
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+	return NULL;
+}
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
-		}
-		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec) {
-			fprintf(stdout, "ERROR: large block reads can't keep up\n");
+//------------------------------------------------
+// Runs in every device large-block write thread,
+// executes its share of the device's large-block
+// writes at a constant rate.
+//
+static void*
+run_large_block_writes(void* pv_dev)
+{
+	rand_seed_thread();
+
+	set_thread_ioprio(g_scfg.large_block_ioprio);
+
+	device* dev = (device*)pv_dev;
+
+	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
+
+	if (! buf) {
+		fprintf(stdout, "ERROR: large block write buffer act_valloc()\n");
+		g_running = false;
+		return NULL;
+	}
+
+	if (parallel_chunks() && ! async_io_setup(g_scfg.large_block_ops_bytes /
+			g_scfg.large_block_chunk_bytes, &tl_aio_ctx)) {
+		free(buf);
+		g_running = false;
+		return NULL;
+	}
+
+	while (g_running) {
+		if (! pace_large_block_op(&dev->large_block_writes,
+				g_lag_large_block_write_hist)) {
+			fprintf(stdout, "ERROR: large block writes can't keep up\n");
 			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
 			g_running = false;
+			break;
+		}
+
+		if (! g_running) {
+			break;
 		}
+
+		write_and_report_large_block(dev, buf);
+		cpu_group_count(g_cpu_large_block, 1, g_scfg.large_block_ops_bytes);
+	}
+
+	if (parallel_chunks()) {
+		async_io_destroy(tl_aio_ctx);
 	}
 
 	free(buf);
@@ -636,45 +1678,142 @@ run_large_block_reads(void* pv_dev)
 }
 
 //------------------------------------------------
-// Runs in every device large-block write thread,
-// executes large-block writes at a constant rate.
+// Runs in every device partial flush thread if
+// flush-max-ms is configured. Tracks how full the
+// device's current write block would be at the
+// configured write rate, and each time flush-max-ms
+// passes without the block filling, rewrites the
+// filled part of it.
 //
 static void*
-run_large_block_writes(void* pv_dev)
+run_partial_flushes(void* pv_dev)
 {
 	rand_seed_thread();
 
+	set_thread_ioprio(g_scfg.large_block_ioprio);
+
 	device* dev = (device*)pv_dev;
 
 	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
 
 	if (! buf) {
-		fprintf(stdout, "ERROR: large block write buffer act_valloc()\n");
+		fprintf(stdout, "ERROR: partial flush buffer act_valloc()\n");
 		g_running = false;
 		return NULL;
 	}
 
-	uint64_t count = 0;
+	double block_bytes = (double)g_scfg.large_block_ops_bytes;
+	double fill_bytes_per_us = g_scfg.large_block_writes_per_sec *
+			block_bytes * dev->large_block_share / 1000000.0;
+
+	uint64_t block_offset = random_large_block_offset(dev);
+	double filled = 0.0;
+	uint64_t flushed = 0;
+	uint64_t last_us = get_us();
+	uint64_t next_us = last_us;
 
 	while (g_running) {
-		write_and_report_large_block(dev, buf, count);
+		next_us += g_scfg.flush_max_us;
 
-		count++;
+		uint64_t now_us = get_us();
 
-		uint64_t target_us = (uint64_t)
-				((double)(count * 1000000 * g_scfg.num_devices) /
-						g_scfg.large_block_writes_per_sec);
+		if (next_us > now_us) {
+			usleep((uint32_t)(next_us - now_us));
+			now_us = get_us();
+		}
 
-		int64_t sleep_us = (int64_t)(target_us - (get_us() - g_run_start_us));
+		filled += fill_bytes_per_us * load_factor() * (now_us - last_us);
+		last_us = now_us;
 
-		if (sleep_us > 0) {
-			usleep((uint32_t)sleep_us);
+		// Block(s) filled - the full-block writes cover them.
+		if (filled >= block_bytes) {
+			filled -= block_bytes * (uint64_t)(filled / block_bytes);
+			flushed = 0;
+			block_offset = random_large_block_offset(dev);
+			continue;
 		}
-		else if (sleep_us < -(int64_t)g_scfg.max_lag_usec) {
-			fprintf(stdout, "ERROR: large block writes can't keep up\n");
-			fprintf(stdout, "drive(s) can't keep up - test stopped\n");
+
+		uint64_t filled_bytes = (uint64_t)filled;
+
+		if (filled_bytes == flushed) {
+			continue;
+		}
+
+		uint32_t size = (uint32_t)(((filled_bytes + dev->min_op_bytes - 1) /
+				dev->min_op_bytes) * dev->min_op_bytes);
+
+		// Salt the block each time.
+		rand_fill(buf, size);
+
+		uint64_t start_time = get_ns();
+		uint64_t stop_time = write_to_device(dev, block_offset, size, buf);
+
+		if (stop_time == -1) {
+			g_running = false;
+			break;
+		}
+
+		histogram_insert_data_point(g_partial_flush_write_hist,
+				safe_delta_ns(start_time, stop_time));
+		atomic64_add(&g_partial_flush_write_bytes, size);
+		cpu_group_count(g_cpu_large_block, 1, size);
+
+		flushed = filled_bytes;
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+//------------------------------------------------
+// Runs in every device's shadow write thread,
+// mirroring the device's large-block writes in
+// the order they were done.
+//
+static void*
+run_shadow_writes(void* pv_dev)
+{
+	rand_seed_thread();
+
+	set_thread_ioprio(g_scfg.large_block_ioprio);
+
+	device* dev = (device*)pv_dev;
+
+	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
+
+	if (! buf) {
+		fprintf(stdout, "ERROR: shadow write buffer act_valloc()\n");
+		g_running = false;
+		return NULL;
+	}
+
+	uint64_t offset;
+
+	while (g_running) {
+		if (queue_pop(dev->shadow_q, (void*)&offset, 100) != QUEUE_OK) {
+			continue;
+		}
+
+		// Salt the block each time.
+		rand_fill(buf, g_scfg.large_block_ops_bytes);
+
+		uint64_t start_time = get_ns();
+
+		if (! pwrite_all(dev->shadow_fd, buf, g_scfg.large_block_ops_bytes,
+				offset)) {
+			fprintf(stdout, "ERROR: writing %s: %d '%s'\n", dev->shadow_name,
+					errno, act_strerror(errno));
 			g_running = false;
+			break;
 		}
+
+		uint64_t stop_time = report_ioprio(start_time, get_ns());
+
+		histogram_insert_data_point(g_shadow_write_hist,
+				safe_delta_ns(start_time, stop_time));
+		atomic64_add(&g_shadow_write_bytes, g_scfg.large_block_ops_bytes);
+		cpu_group_count(g_cpu_shadow, 1, g_scfg.large_block_ops_bytes);
 	}
 
 	free(buf);
@@ -689,6 +1828,8 @@ run_large_block_writes(void* pv_dev)
 static void*
 run_tomb_raider(void* pv_dev)
 {
+	set_thread_ioprio(g_scfg.tomb_raider_ioprio);
+
 	device* dev = (device*)pv_dev;
 
 	uint8_t* buf = act_valloc(g_scfg.large_block_ops_bytes);
@@ -707,7 +1848,8 @@ run_tomb_raider(void* pv_dev)
 			usleep(g_scfg.tomb_raider_sleep_us);
 		}
 
-		read_from_device(dev, offset, g_scfg.large_block_ops_bytes, buf);
+		read_from_device(dev, offset, g_scfg.large_block_ops_bytes, buf, NULL);
+		cpu_group_count(g_cpu_tomb_raider, 1, g_scfg.large_block_ops_bytes);
 
 		offset += g_scfg.large_block_ops_bytes;
 
@@ -727,29 +1869,45 @@ run_tomb_raider(void* pv_dev)
 // reports the duration.
 //
 static void*
-run_transactions(void* pv_req_q)
+run_transactions(void* pv_n)
 {
+	if (g_scfg.perf_counters) {
+		perf_group_add_self(g_perf_transactions);
+	}
+
 	rand_seed_thread();
 
-	queue* req_q = (queue*)pv_req_q;
+	set_thread_ioprio(g_scfg.transaction_ioprio);
+
+	uint32_t n = (uint32_t)(uintptr_t)pv_n;
+	uint32_t q_index = n / max_threads_per_queue();
+	uint32_t slot = n % max_threads_per_queue();
+	queue* req_q = g_trans_qs[q_index];
+
+	if (g_scfg.coroutines_per_thread != 0) {
+		schedule_trans_coroutines(req_q, q_index, slot);
+		return NULL;
+	}
+
 	trans_req req;
 
 	while (g_running) {
-		if (queue_pop(req_q, (void*)&req, 100) != QUEUE_OK) {
+		// Not needed by the adaptive pool right now.
+		if (! trans_thread_active(slot)) {
+			usleep(TRANS_PARK_US);
 			continue;
 		}
 
-		uint8_t stack_buffer[req.size + 4096];
-		uint8_t* buf = align_4096(stack_buffer);
-
-		if (req.is_write) {
-			write_and_report(&req, buf);
-		}
-		else {
-			read_and_report(&req, buf);
+		if (! pop_trans_req(req_q, q_index, &req, 100)) {
+			continue;
 		}
 
-		atomic32_decr(&g_reqs_queued);
+		// Big enough for an index read too.
+		uint32_t buf_size = req.size > INDEX_IO_SIZE ? req.size : INDEX_IO_SIZE;
+		uint8_t stack_buffer[buf_size + 4096];
+		uint8_t* buf = align_4096(stack_buffer);
+
+		do_transaction(&req, buf);
 	}
 
 	return NULL;
@@ -761,49 +1919,250 @@ run_transactions(void* pv_req_q)
 //
 
 //------------------------------------------------
-// Aligned memory allocation.
+// Make a device IO latency histogram for an IO
+// priority, unless we already have one.
 //
-static uint8_t*
-act_valloc(size_t size)
+static void
+add_ioprio_hist(int ioprio, histogram_scale scale)
 {
-	void* pv;
+	for (uint32_t i = 0; i < g_num_ioprio_hists; i++) {
+		if (g_ioprio_hists[i].ioprio == ioprio) {
+			return;
+		}
+	}
 
-	return posix_memalign(&pv, 4096, size) == 0 ? (uint8_t*)pv : 0;
+	ioprio_hist* ih = &g_ioprio_hists[g_num_ioprio_hists++];
+	char name[IOPRIO_NAME_SIZE];
+
+	ioprio_name(ioprio, name);
+
+	char* comma = strchr(name, ',');
+
+	if (comma) {
+		*comma = '-'; // e.g. ioprio-be-4
+	}
+
+	ih->ioprio = ioprio;
+	sprintf(ih->tag, "ioprio-%s", name);
+
+	if (! (ih->hist = histogram_create(scale))) {
+		exit(-1);
+	}
 }
 
 //------------------------------------------------
-// Discover device storage capacity, etc.
+// Once per interval - back off the load factor if
+// we had to shed anything, else recover it.
 //
-static bool
-discover_device(device* dev)
+static void
+adjust_throttle()
 {
-	int fd = fd_get(dev);
+	if (g_overloaded) {
+		g_overloaded = false;
+		g_throttle_factor *= THROTTLE_BACKOFF;
 
-	if (fd == -1) {
-		return false;
+		if (g_throttle_factor < THROTTLE_MIN_FACTOR) {
+			g_throttle_factor = THROTTLE_MIN_FACTOR;
+		}
 	}
+	else if (g_throttle_factor < 1.0) {
+		g_throttle_factor += THROTTLE_RECOVERY;
 
-	uint64_t device_bytes;
+		if (g_throttle_factor > 1.0) {
+			g_throttle_factor = 1.0;
+		}
+	}
+}
 
-	if (g_scfg.file_size == 0) {
-		ioctl(fd, BLKGETSIZE64, &device_bytes);
+//------------------------------------------------
+// Once per interval - grow the active transaction
+// thread pool if requests waited too long in the
+// queues this interval, else shrink it towards the
+// smallest size not yet seen to miss the target.
+// Back off if growing made waits no better - more
+// threads would only contend.
+//
+static void
+adjust_trans_threads()
+{
+	static uint64_t last_wait_ns = 0;
+	static uint64_t last_waits = 0;
+	static double last_wait_us = 0.0;
+	static uint32_t last_active = 0;
+	static uint32_t too_few = 0;        // largest pool seen to miss the target
+	static uint32_t enough = 0;         // smallest pool seen to meet it
+	static uint32_t ceiling = 0;        // growing beyond this didn't help
+	static bool warm = false;           // first interval includes start-up
+
+	uint64_t wait_ns = atomic64_get(g_queue_wait_ns);
+	uint64_t waits = atomic64_get(g_queue_waits);
+	uint64_t n_waits = waits - last_waits;
+	double wait_us = n_waits == 0 ? 0.0 :
+			(double)(wait_ns - last_wait_ns) / (double)n_waits / 1000.0;
+
+	last_wait_ns = wait_ns;
+	last_waits = waits;
+
+	uint32_t active = atomic32_get(g_trans_threads_active);
+	uint32_t next = active;
+	const char* why = "";
+
+	if (! warm || n_waits == 0) {
+		// Nothing reliable to learn.
+		warm = true;
 	}
-	else { // undocumented file mode
-		device_bytes = g_scfg.file_size;
+	else if (wait_us > g_scfg.queue_wait_target_us) {
+		if (last_active < active && wait_us >= last_wait_us) {
+			ceiling = last_active;
+			next = last_active;
+			why = " (growing didn't help)";
+		}
+		else {
+			too_few = active;
 
-		if (ftruncate(fd, (off_t)device_bytes) != 0) {
-			fprintf(stdout, "ERROR: ftruncate file %s errno %d '%s'\n",
-					dev->name, errno, act_strerror(errno));
-			fd_put(dev, fd);
-			return false;
+			if (enough <= active) {
+				enough = 0; // the load went up - forget it
+			}
+
+			// Double until we find a big enough pool, then bisect.
+			next = enough == 0 ?
+					active * 2 : active + ((enough - active + 1) / 2);
+
+			if (ceiling != 0 && next > ceiling) {
+				next = ceiling;
+			}
+
+			if (next > g_scfg.threads_per_queue_max) {
+				next = g_scfg.threads_per_queue_max;
+			}
 		}
 	}
+	else {
+		enough = active;
 
-	dev->n_large_blocks = device_bytes / g_scfg.large_block_ops_bytes;
-	dev->min_op_bytes = discover_min_op_bytes(fd, dev->name);
-	fd_put(dev, fd);
+		if (too_few >= active) {
+			too_few = 0; // the load went down - forget it
+		}
 
-	if (dev->n_large_blocks == 0) {
+		next = active - ((active - too_few) / 2);
+
+		if (next == 0) {
+			next = 1;
+		}
+	}
+
+	last_wait_us = wait_us;
+	last_active = active;
+
+	fprintf(stdout, "queue-wait-us: %.1lf threads-per-queue: %" PRIu32,
+			wait_us, active);
+
+	if (next != active) {
+		fprintf(stdout, " -> %" PRIu32 "%s", next, why);
+		atomic32_set(&g_trans_threads_active, next);
+	}
+
+	fprintf(stdout, "\n");
+}
+
+//------------------------------------------------
+// Aligned memory allocation.
+//
+static uint8_t*
+act_valloc(size_t size)
+{
+	void* pv;
+
+	return posix_memalign(&pv, 4096, size) == 0 ? (uint8_t*)pv : 0;
+}
+
+//------------------------------------------------
+// Do one whole transaction device IO. In a
+// coroutine, submit it as async IO and yield until
+// it completes, otherwise just block.
+//
+static bool
+device_io(int fd, bool is_write, uint8_t* buf, uint32_t size, uint64_t offset)
+{
+	trans_coroutine* tc = tl_trans_co;
+
+	if (tc == NULL) {
+		return is_write ?
+				pwrite_all(fd, buf, size, (off_t)offset) :
+				pread_all(fd, buf, size, (off_t)offset);
+	}
+
+	struct iocb cb;
+	struct iocb* p_cb = &cb;
+
+	async_io_prep(&cb, fd, is_write, buf, size, (off_t)offset);
+	cb.aio_data = (uint64_t)(uintptr_t)tc;
+
+	int rv = async_io_submit(tl_aio_ctx, 1, &p_cb);
+
+	if (rv != 1) {
+		if (rv == 0) {
+			errno = EAGAIN;
+		}
+
+		return false;
+	}
+
+	coroutine_yield();
+
+	if (tc->io_res != (int64_t)size) {
+		errno = tc->io_res < 0 ? (int)-tc->io_res : EIO;
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Discover device storage capacity, etc.
+//
+static bool
+discover_device(device* dev)
+{
+	uint64_t device_bytes;
+
+	if (g_scfg.pmem) {
+		if (! (dev->pmem_base = pmem_map(dev->name, g_scfg.file_size,
+				&device_bytes))) {
+			return false;
+		}
+
+		dev->pmem_bytes = device_bytes;
+		dev->n_large_blocks = device_bytes / g_scfg.large_block_ops_bytes;
+		dev->min_op_bytes = PMEM_CACHE_LINE_SIZE; // no block size to honor
+	}
+	else {
+		int fd = fd_get(dev, true);
+
+		if (fd == -1) {
+			return false;
+		}
+
+		if (g_scfg.file_size == 0) {
+			ioctl(fd, BLKGETSIZE64, &device_bytes);
+		}
+		else { // undocumented file mode
+			device_bytes = g_scfg.file_size;
+
+			if (ftruncate(fd, (off_t)device_bytes) != 0) {
+				fprintf(stdout, "ERROR: ftruncate file %s errno %d '%s'\n",
+						dev->name, errno, act_strerror(errno));
+				fd_put(dev, fd, true);
+				return false;
+			}
+		}
+
+		dev->n_large_blocks = device_bytes / g_scfg.large_block_ops_bytes;
+		dev->min_op_bytes = discover_min_op_bytes(fd, dev->name);
+		fd_put(dev, fd, true);
+	}
+
+	if (dev->n_large_blocks == 0) {
 		fprintf(stdout, "ERROR: %s ioctl to discover size\n", dev->name);
 		return false;
 	}
@@ -812,6 +2171,13 @@ discover_device(device* dev)
 		return false;
 	}
 
+	if (g_scfg.large_block_chunk_bytes != 0 &&
+			g_scfg.large_block_chunk_bytes < dev->min_op_bytes) {
+		fprintf(stdout, "ERROR: %s large-block chunks below minimum IO size\n",
+				dev->name);
+		return false;
+	}
+
 	fprintf(stdout, "%s size = %" PRIu64 " bytes, %" PRIu64 " large blocks, "
 			"minimum IO size = %" PRIu32 " bytes\n",
 			dev->name, device_bytes, dev->n_large_blocks,
@@ -859,6 +2225,51 @@ discover_min_op_bytes(int fd, const char* name)
 	return 0;
 }
 
+//------------------------------------------------
+// Find an index device's size - index IO is all
+// INDEX_IO_SIZE, aligned.
+//
+static bool
+discover_index_device(device* dev)
+{
+	int fd = fd_get(dev, true);
+
+	if (fd == -1) {
+		return false;
+	}
+
+	uint64_t device_bytes;
+
+	if (g_scfg.file_size == 0) {
+		ioctl(fd, BLKGETSIZE64, &device_bytes);
+	}
+	else { // undocumented file mode
+		device_bytes = g_scfg.file_size;
+
+		if (ftruncate(fd, (off_t)device_bytes) != 0) {
+			fprintf(stdout, "ERROR: ftruncate file %s errno %d '%s'\n",
+					dev->name, errno, act_strerror(errno));
+			fd_put(dev, fd, true);
+			return false;
+		}
+	}
+
+	fd_put(dev, fd, true);
+
+	dev->min_op_bytes = INDEX_IO_SIZE;
+	dev->n_read_offsets = device_bytes / INDEX_IO_SIZE;
+
+	if (dev->n_read_offsets == 0) {
+		fprintf(stdout, "ERROR: %s ioctl to discover size\n", dev->name);
+		return false;
+	}
+
+	fprintf(stdout, "%s index device size = %" PRIu64 " bytes\n", dev->name,
+			device_bytes);
+
+	return true;
+}
+
 //------------------------------------------------
 // Discover device's read request pattern.
 //
@@ -873,7 +2284,7 @@ discover_read_pattern(device* dev)
 
 	// Number of "min-op"-sized blocks per (smallest) read request.
 	uint32_t read_req_min_op_blocks =
-			(g_scfg.record_stored_bytes + dev->min_op_bytes - 1) /
+			(dev->record_stored_bytes + dev->min_op_bytes - 1) /
 					dev->min_op_bytes;
 
 	// Size in bytes per (smallest) read request.
@@ -881,7 +2292,7 @@ discover_read_pattern(device* dev)
 
 	// Number of "min-op"-sized blocks per (largest) read request.
 	uint32_t read_req_min_op_blocks_rmx =
-			(g_scfg.record_stored_bytes_rmx + dev->min_op_bytes - 1) /
+			(dev->record_stored_bytes_rmx + dev->min_op_bytes - 1) /
 					dev->min_op_bytes;
 
 	// Number of read request sizes in configured range.
@@ -893,6 +2304,49 @@ discover_read_pattern(device* dev)
 	dev->n_read_offsets = n_min_op_blocks - read_req_min_op_blocks_rmx + 1;
 }
 
+//------------------------------------------------
+// Open a device's shadow and make sure it can
+// hold everything written to the device.
+//
+static bool
+discover_shadow(device* dev)
+{
+	bool direct = g_scfg.file_size == 0 || g_scfg.file_direct_io;
+	int direct_flags = O_DIRECT | (g_scfg.disable_odsync ? 0 : O_DSYNC);
+	int flags = O_RDWR | (direct ? direct_flags : 0) |
+			(g_scfg.file_size == 0 ? 0 : O_CREAT);
+
+	dev->shadow_fd = open(dev->shadow_name, flags, S_IRUSR | S_IWUSR);
+
+	if (dev->shadow_fd == -1) {
+		fprintf(stdout, "ERROR: open shadow device %s errno %d '%s'\n",
+				dev->shadow_name, errno, act_strerror(errno));
+		return false;
+	}
+
+	uint64_t device_bytes = dev->n_large_blocks * g_scfg.large_block_ops_bytes;
+	uint64_t shadow_bytes = 0;
+
+	if (g_scfg.file_size == 0) {
+		ioctl(dev->shadow_fd, BLKGETSIZE64, &shadow_bytes);
+	}
+	else if (ftruncate(dev->shadow_fd, (off_t)device_bytes) == 0) {
+		shadow_bytes = device_bytes;
+	}
+
+	if (shadow_bytes < device_bytes) {
+		fprintf(stdout, "ERROR: shadow %s smaller than %s\n", dev->shadow_name,
+				dev->name);
+		close(dev->shadow_fd);
+		return false;
+	}
+
+	fprintf(stdout, "%s shadow %s size = %" PRIu64 " bytes\n", dev->name,
+			dev->shadow_name, shadow_bytes);
+
+	return true;
+}
+
 //------------------------------------------------
 // Discover device's write request pattern.
 //
@@ -911,7 +2365,7 @@ discover_write_pattern(device* dev)
 
 	// Number of "min-commit"-sized blocks per (smallest) write request.
 	uint32_t write_req_min_commit_blocks =
-			(g_scfg.record_stored_bytes + dev->min_commit_bytes - 1) /
+			(dev->record_stored_bytes + dev->min_commit_bytes - 1) /
 					dev->min_commit_bytes;
 
 	// Size in bytes per (smallest) write request.
@@ -919,7 +2373,7 @@ discover_write_pattern(device* dev)
 
 	// Number of "min-commit"-sized blocks per (largest) write request.
 	uint32_t write_req_min_commit_blocks_rmx =
-			(g_scfg.record_stored_bytes_rmx + dev->min_commit_bytes - 1) /
+			(dev->record_stored_bytes_rmx + dev->min_commit_bytes - 1) /
 					dev->min_commit_bytes;
 
 	// Number of write request sizes in configured range.
@@ -933,178 +2387,1508 @@ discover_write_pattern(device* dev)
 }
 
 //------------------------------------------------
-// Close all file descriptors for a device.
+// Do one transaction and account for it.
 //
 static void
-fd_close_all(device* dev)
+do_transaction(trans_req* req, uint8_t* buf)
 {
-	int fd;
+	uint64_t handoff_ns = safe_delta_ns(req->start_time, get_ns());
 
-	while (queue_pop(dev->fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
-		close(fd);
+	histogram_insert_data_point(g_handoff_hist, handoff_ns);
+
+	if (g_scfg.threads_per_queue_max != 0) {
+		atomic64_add(&g_queue_wait_ns, (int64_t)handoff_ns);
+		atomic64_incr(&g_queue_waits);
+	}
+
+	if (req->is_write) {
+		write_and_report(req, buf);
+	}
+	else {
+		read_and_report(req, buf);
 	}
+
+	cpu_group_count(g_cpu_transactions, 1, req->size);
+
+	atomic32_decr(&g_reqs_queued);
 }
 
 //------------------------------------------------
-// Get a safe file descriptor for a device.
+// Write back and drop all cached pages of the
+// device files, so the next load step starts cold.
 //
-static int
-fd_get(device* dev)
+static void
+drop_page_cache()
 {
-	int fd = -1;
-
-	if (queue_pop(dev->fd_q, (void*)&fd, QUEUE_NO_WAIT) != QUEUE_OK) {
-		int direct_flags = O_DIRECT | (g_scfg.disable_odsync ? 0 : O_DSYNC);
-		int flags = O_RDWR | (g_scfg.file_size == 0 ? direct_flags : O_CREAT);
+	if (g_scfg.pmem) {
+		return; // the mapped pages are the storage
+	}
 
-		fd = open(dev->name, flags, S_IRUSR | S_IWUSR);
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+		device* dev = &g_devices[d];
+		int fd = fd_get(dev, true);
 
 		if (fd == -1) {
-			fprintf(stdout, "ERROR: open device %s errno %d '%s'\n", dev->name,
+			continue;
+		}
+
+		if (fdatasync(fd) != 0) {
+			fprintf(stdout, "ERROR: fdatasync %s: %d '%s'\n", dev->name,
 					errno, act_strerror(errno));
 		}
-	}
 
-	return fd;
-}
+		int rv = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
 
-//------------------------------------------------
-// Recycle a safe file descriptor for a device.
-//
-static void
-fd_put(device* dev, int fd)
-{
-	queue_push(dev->fd_q, (void*)&fd);
+		if (rv != 0) {
+			fprintf(stdout, "ERROR: drop cache %s: %d '%s'\n", dev->name, rv,
+					act_strerror(rv));
+		}
+
+		fd_put(dev, fd, true);
+	}
 }
 
 //------------------------------------------------
-// Do one transaction read operation and report.
+// Record the current load step's results, and move
+// on to the next step's load.
 //
 static void
-read_and_report(trans_req* read_req, uint8_t* buf)
+end_load_step(uint64_t duration_us)
 {
-	uint64_t raw_start_time = get_ns();
-	uint64_t stop_time = read_from_device(read_req->dev, read_req->offset,
-			read_req->size, buf);
+	load_step* step = &g_load_steps[g_num_steps_done];
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_raw_read_hist,
-				safe_delta_ns(raw_start_time, stop_time));
-		histogram_insert_data_point(g_read_hist,
-				safe_delta_ns(read_req->start_time, stop_time));
-		histogram_insert_data_point(read_req->dev->raw_read_hist,
-				safe_delta_ns(raw_start_time, stop_time));
+	step->multiplier = g_scfg.load_multipliers[g_num_steps_done];
+	step->duration_us = duration_us;
+
+	step_stats(g_read_hist, g_step_read_counts, &step->reads);
+	step_stats(g_write_hist, g_step_write_counts, &step->writes);
+	step_stats(g_large_block_read_hist, g_step_large_block_read_counts,
+			&step->large_block_reads);
+	step_stats(g_large_block_write_hist, g_step_large_block_write_counts,
+			&step->large_block_writes);
+
+	fprintf(stdout, "load step %" PRIu32 " (%gx) done\n\n",
+			g_num_steps_done + 1, step->multiplier);
+
+	g_num_steps_done++;
+
+	if (g_num_steps_done < g_scfg.num_load_steps) {
+		if (g_scfg.file_drop_cache) {
+			drop_page_cache();
+		}
+
+		g_load_factor = g_scfg.load_multipliers[g_num_steps_done];
 	}
 }
 
 //------------------------------------------------
-// Do one large block read operation and report.
+// Close all file descriptors for a device.
 //
 static void
-read_and_report_large_block(device* dev, uint8_t* buf)
+fd_close_all(device* dev)
 {
-	uint64_t offset = random_large_block_offset(dev);
-	uint64_t start_time = get_ns();
-	uint64_t stop_time = read_from_device(dev, offset,
-			g_scfg.large_block_ops_bytes, buf);
+	int fd;
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_large_block_read_hist,
-				safe_delta_ns(start_time, stop_time));
+	while (queue_pop(dev->read_fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
+		close(fd);
+	}
+
+	while (queue_pop(dev->write_fd_q, (void*)&fd, QUEUE_NO_WAIT) == QUEUE_OK) {
+		close(fd);
 	}
 }
 
 //------------------------------------------------
-// Do one device read operation.
+// Get a safe file descriptor for a device.
 //
-static uint64_t
-read_from_device(device* dev, uint64_t offset, uint32_t size, uint8_t* buf)
+static int
+fd_get(device* dev, bool is_write)
 {
-	int fd = fd_get(dev);
+	int fd = -1;
 
-	if (fd == -1) {
-		return -1;
-	}
+	queue* fd_q = is_write ? dev->write_fd_q : dev->read_fd_q;
 
-	if (! pread_all(fd, buf, size, offset)) {
-		close(fd);
-		fprintf(stdout, "ERROR: reading %s: %d '%s'\n", dev->name, errno,
-				act_strerror(errno));
-		return -1;
-	}
+	if (queue_pop(fd_q, (void*)&fd, QUEUE_NO_WAIT) != QUEUE_OK) {
+		int flags;
 
-	uint64_t stop_ns = get_ns();
+		bool direct = g_scfg.file_size == 0 || g_scfg.file_direct_io;
 
-	fd_put(dev, fd);
+		if (is_write) {
+			int direct_flags = O_DIRECT | (g_scfg.disable_odsync ? 0 : O_DSYNC);
 
-	return stop_ns;
-}
+			flags = O_RDWR | (direct ? direct_flags : 0) |
+					(g_scfg.file_size == 0 ? 0 : O_CREAT);
+		}
+		else {
+			flags = O_RDONLY | (direct ? O_DIRECT : 0);
+		}
 
-//------------------------------------------------
-// Do one transaction write operation and report.
-//
-static void
-write_and_report(trans_req* write_req, uint8_t* buf)
-{
-	// Salt each record.
-	rand_fill(buf, write_req->size);
+		fd = open(dev->name, flags, S_IRUSR | S_IWUSR);
 
-	uint64_t raw_start_time = get_ns();
-	uint64_t stop_time = write_to_device(write_req->dev, write_req->offset,
-			write_req->size, buf);
+		if (fd == -1) {
+			fprintf(stdout, "ERROR: open device %s errno %d '%s'\n", dev->name,
+					errno, act_strerror(errno));
+		}
+		else if (! direct && g_scfg.file_fadvise != -1) {
+			int rv = posix_fadvise(fd, 0, 0, g_scfg.file_fadvise);
 
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_raw_write_hist,
-				safe_delta_ns(raw_start_time, stop_time));
-		histogram_insert_data_point(g_write_hist,
-				safe_delta_ns(write_req->start_time, stop_time));
-		histogram_insert_data_point(write_req->dev->raw_write_hist,
-				safe_delta_ns(raw_start_time, stop_time));
+			if (rv != 0) {
+				fprintf(stdout, "ERROR: fadvise %s: %d '%s'\n", dev->name,
+						rv, act_strerror(rv));
+			}
+		}
 	}
+
+	return fd;
 }
 
 //------------------------------------------------
-// Do one large block write operation and report.
+// Recycle a safe file descriptor for a device.
 //
 static void
-write_and_report_large_block(device* dev, uint8_t* buf, uint64_t count)
+fd_put(device* dev, int fd, bool is_write)
 {
-	// Salt the block each time.
-	rand_fill(buf, g_scfg.large_block_ops_bytes);
-
-	uint64_t offset = random_large_block_offset(dev);
-	uint64_t start_time = get_ns();
-	uint64_t stop_time = write_to_device(dev, offset,
-			g_scfg.large_block_ops_bytes, buf);
-
-	if (stop_time != -1) {
-		histogram_insert_data_point(g_large_block_write_hist,
-				safe_delta_ns(start_time, stop_time));
-	}
+	queue_push(is_write ? dev->write_fd_q : dev->read_fd_q, (void*)&fd);
 }
 
 //------------------------------------------------
-// Do one device write operation.
+// Do one large-block op as chunks all submitted
+// at once via async IO, reporting each chunk's
+// latency from submission. Returns the op's stop
+// time, or -1 on error.
 //
 static uint64_t
-write_to_device(device* dev, uint64_t offset, uint32_t size, const uint8_t* buf)
+large_block_async_io(device* dev, uint64_t offset, uint8_t* buf,
+		bool is_write, histogram* chunk_hist)
 {
-	int fd = fd_get(dev);
+	uint32_t chunk_bytes = g_scfg.large_block_chunk_bytes;
+	uint32_t n_chunks = g_scfg.large_block_ops_bytes / chunk_bytes;
+	struct iocb cbs[n_chunks];
+	struct iocb* p_cbs[n_chunks];
+	struct io_event events[n_chunks];
+
+	int fd = fd_get(dev, is_write);
 
 	if (fd == -1) {
 		return -1;
 	}
 
-	if (! pwrite_all(fd, buf, size, offset)) {
-		close(fd);
-		fprintf(stdout, "ERROR: writing %s: %d '%s'\n", dev->name, errno,
-				act_strerror(errno));
-		return -1;
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		async_io_prep(&cbs[i], fd, is_write, buf + (i * chunk_bytes),
+				chunk_bytes, (off_t)(offset + (i * chunk_bytes)));
+		p_cbs[i] = &cbs[i];
 	}
 
-	uint64_t stop_ns = get_ns();
+	uint64_t start_ns = get_ns();
+	uint64_t stop_ns = start_ns;
+	int n_submitted = async_io_submit(tl_aio_ctx, n_chunks, p_cbs);
+	int err = n_submitted < 0 ? errno : 0;
 
-	fd_put(dev, fd);
+	if (n_submitted >= 0 && n_submitted < (int)n_chunks) {
+		err = EAGAIN;
+	}
 
-	return stop_ns;
+	// Reap whatever was submitted, even if we're going to fail.
+	for (int n_done = 0; n_done < n_submitted; ) {
+		int n = async_io_reap(tl_aio_ctx, 1, n_submitted - n_done, events,
+				NULL);
+
+		if (n < 0) {
+			// Can't know what's still in flight - can't carry on.
+			fprintf(stdout, "ERROR: io_getevents %s: %d '%s'\n", dev->name,
+					errno, act_strerror(errno));
+			fprintf(stdout, "test stopped\n");
+			exit(-1);
+		}
+
+		stop_ns = get_ns();
+
+		for (int e = 0; e < n; e++) {
+			if (events[e].res != (int64_t)chunk_bytes) {
+				err = events[e].res < 0 ? (int)-events[e].res : EIO;
+				continue;
+			}
+
+			histogram_insert_data_point(chunk_hist,
+					safe_delta_ns(start_ns, stop_ns));
+		}
+
+		n_done += n;
+	}
+
+	if (err != 0) {
+		close(fd);
+		fprintf(stdout, "ERROR: async %s %s: %d '%s'\n",
+				is_write ? "writing" : "reading", dev->name, err,
+				act_strerror(err));
+		return -1;
+	}
+
+	fd_put(dev, fd, is_write);
+
+	return report_ioprio(start_ns, stop_ns);
+}
+
+//------------------------------------------------
+// Do one large-block read or write - split into
+// chunks if configured, reporting each chunk.
+// Returns the op's stop time, or -1 on error.
+//
+static uint64_t
+large_block_io(device* dev, uint64_t offset, uint8_t* buf, bool is_write)
+{
+	uint32_t chunk_bytes = g_scfg.large_block_chunk_bytes;
+
+	if (chunk_bytes == 0) {
+		return is_write ?
+				write_to_device(dev, offset, g_scfg.large_block_ops_bytes,
+						buf) :
+				read_from_device(dev, offset, g_scfg.large_block_ops_bytes,
+						buf, NULL);
+	}
+
+	histogram* chunk_hist = is_write ?
+			g_chunk_large_block_write_hist : g_chunk_large_block_read_hist;
+
+	if (parallel_chunks()) {
+		return large_block_async_io(dev, offset, buf, is_write, chunk_hist);
+	}
+
+	uint32_t n_chunks = g_scfg.large_block_ops_bytes / chunk_bytes;
+	uint64_t block_start_ns = get_ns();
+	uint64_t stop_ns = -1;
+
+	// As in parallel mode, the IO priority histogram gets one data point per
+	// block, not one per chunk.
+	histogram* ioprio_hist = tl_ioprio_hist;
+
+	tl_ioprio_hist = NULL;
+
+	for (uint32_t i = 0; i < n_chunks; i++) {
+		uint64_t chunk_offset = offset + (i * chunk_bytes);
+		uint8_t* chunk_buf = buf + (i * chunk_bytes);
+		uint64_t start_ns = get_ns();
+
+		stop_ns = is_write ?
+				write_to_device(dev, chunk_offset, chunk_bytes, chunk_buf) :
+				read_from_device(dev, chunk_offset, chunk_bytes, chunk_buf,
+						NULL);
+
+		if (stop_ns == -1) {
+			break;
+		}
+
+		histogram_insert_data_point(chunk_hist,
+				safe_delta_ns(start_ns, stop_ns));
+	}
+
+	tl_ioprio_hist = ioprio_hist;
+
+	return stop_ns == -1 ? -1 : report_ioprio(block_start_ns, stop_ns);
+}
+
+//------------------------------------------------
+// Size of the biggest IO a transaction can do, to
+// size each coroutine's buffer.
+//
+static uint32_t
+max_trans_req_bytes()
+{
+	// Big enough for an index read too.
+	uint32_t max_bytes = INDEX_IO_SIZE;
+
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+		const device* dev = &g_devices[d];
+		uint32_t read_max = dev->read_bytes +
+				(dev->min_op_bytes * (dev->n_read_sizes - 1));
+
+		if (read_max > max_bytes) {
+			max_bytes = read_max;
+		}
+
+		if (! g_scfg.commit_to_device) {
+			continue;
+		}
+
+		uint32_t write_max = dev->write_bytes +
+				(dev->min_commit_bytes * (dev->n_write_sizes - 1));
+
+		if (write_max > max_bytes) {
+			max_bytes = write_max;
+		}
+	}
+
+	return max_bytes;
+}
+
+//------------------------------------------------
+// Claim the next op of a large-block stream and
+// sleep until it's due. Returns false if the
+// stream fell too far behind and we should stop.
+//
+static bool
+pace_large_block_op(large_block_stream* stream, histogram* lag_hist)
+{
+	pthread_mutex_lock(&stream->lock);
+
+	int64_t sleep_us = pacer_claim_sleep_us(&stream->pace, load_factor());
+	bool keeping_up = sleep_us >= -(int64_t)g_scfg.max_lag_usec ||
+			shed_lag(&stream->pace, &g_large_block_ops_shed);
+
+	pthread_mutex_unlock(&stream->lock);
+
+	uint64_t due_us = get_us() + (sleep_us > 0 ? (uint64_t)sleep_us : 0);
+
+	if (sleep_us > 0) {
+		usleep((uint32_t)sleep_us);
+	}
+	else if (sleep_us < 0) {
+		atomic64_incr(&g_large_block_ops_late);
+	}
+
+	// Lag includes any oversleep, and how late the op was when claimed.
+	uint64_t now_us = get_us();
+	uint64_t lag_us = (now_us > due_us ? now_us - due_us : 0) +
+			(sleep_us < 0 ? (uint64_t)-sleep_us : 0);
+
+	histogram_insert_data_point(lag_hist, lag_us * 1000);
+
+	return keeping_up;
+}
+
+//------------------------------------------------
+// Get a request for a transaction thread. With
+// work stealing, drain our own queue first, then
+// help others, and only block (briefly) when every
+// queue is empty.
+//
+static bool
+pop_trans_req(queue* req_q, uint32_t q_index, trans_req* req, int ms_wait)
+{
+	if (! g_scfg.work_stealing) {
+		return queue_pop(req_q, (void*)req, ms_wait) == QUEUE_OK;
+	}
+
+	return queue_pop(req_q, (void*)req, QUEUE_NO_WAIT) == QUEUE_OK ||
+			steal_req(q_index, req) ||
+			(ms_wait != QUEUE_NO_WAIT &&
+					queue_pop(req_q, (void*)req, 1) == QUEUE_OK);
+}
+
+//------------------------------------------------
+// Queue a large-block write to be mirrored to the
+// device's shadow, unless the shadow is too far
+// behind.
+//
+static void
+queue_shadow_write(device* dev, uint64_t offset)
+{
+	if (queue_sz(dev->shadow_q) >= g_scfg.max_shadow_writes_queued) {
+		if (g_scfg.on_overload == OVERLOAD_STOP) {
+			fprintf(stdout, "ERROR: too many shadow writes queued\n");
+			fprintf(stdout, "shadow drive(s) can't keep up - test stopped\n");
+			g_running = false;
+			return;
+		}
+
+		atomic64_incr(&g_shadow_writes_shed);
+		g_overloaded = true;
+		return;
+	}
+
+	queue_push(dev->shadow_q, (void*)&offset);
+}
+
+//------------------------------------------------
+// Do one transaction read operation and report.
+//
+static void
+read_and_report(trans_req* read_req, uint8_t* buf)
+{
+	// Find the record via the index first, as Aerospike would.
+	if (g_scfg.num_index_devices != 0) {
+		read_index_and_report(buf);
+	}
+
+	cache_result cache = CACHE_UNKNOWN;
+	uint64_t raw_start_time = get_ns();
+	uint64_t stop_time = read_from_device(read_req->dev, read_req->offset,
+			read_req->size, buf, &cache);
+
+	if (stop_time != -1) {
+		histogram_insert_data_point(g_raw_read_hist,
+				safe_delta_ns(raw_start_time, stop_time));
+
+		if (cache != CACHE_UNKNOWN) {
+			histogram_insert_data_point(cache == CACHE_HIT ?
+					g_cache_hit_read_hist : g_cache_miss_read_hist,
+					safe_delta_ns(raw_start_time, stop_time));
+		}
+
+		if (g_scfg.recent_read_pct != 0) {
+			histogram_insert_data_point(read_req->is_recent ?
+					g_recent_read_hist : g_cold_read_hist,
+					safe_delta_ns(raw_start_time, stop_time));
+		}
+
+		histogram_insert_data_point(g_read_hist,
+				safe_delta_ns(read_req->start_time, stop_time));
+		histogram_insert_data_point(read_req->dev->raw_read_hist,
+				safe_delta_ns(raw_start_time, stop_time));
+	}
+}
+
+//------------------------------------------------
+// Do one large block read operation and report.
+//
+static void
+read_and_report_large_block(device* dev, uint8_t* buf)
+{
+	uint64_t offset = random_large_block_offset(dev);
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = large_block_io(dev, offset, buf, false);
+
+	if (stop_time != -1) {
+		histogram_insert_data_point(g_large_block_read_hist,
+				safe_delta_ns(start_time, stop_time));
+		atomic64_incr(&dev->n_large_block_reads);
+	}
+}
+
+//------------------------------------------------
+// Do one index device read operation and report.
+//
+static void
+read_index_and_report(uint8_t* buf)
+{
+	device* dev = &g_index_devices[rand_32() % g_scfg.num_index_devices];
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = read_from_device(dev, random_read_offset(dev),
+			INDEX_IO_SIZE, buf, NULL);
+
+	if (stop_time != -1) {
+		histogram_insert_data_point(g_index_read_hist,
+				safe_delta_ns(start_time, stop_time));
+	}
+}
+
+//------------------------------------------------
+// Do one device read operation. In buffered mode,
+// if p_cache is not NULL, first try a non-blocking
+// read to find out whether the page cache has it.
+//
+static uint64_t
+read_from_device(device* dev, uint64_t offset, uint32_t size, uint8_t* buf,
+		cache_result* p_cache)
+{
+	uint64_t start_ns = tl_ioprio_hist != NULL ? get_ns() : 0;
+
+	if (g_scfg.pmem) {
+		pmem_read(buf, dev->pmem_base + offset, size);
+		atomic64_add(&g_pmem_read_bytes, size);
+
+		return report_ioprio(start_ns, get_ns());
+	}
+
+	int fd = fd_get(dev, false);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (p_cache != NULL && buffered_io()) {
+		struct iovec iov = { .iov_base = buf, .iov_len = size };
+		ssize_t rv = preadv2(fd, &iov, 1, (off_t)offset, RWF_NOWAIT);
+
+		if (rv == (ssize_t)size) {
+			uint64_t stop_ns = get_ns();
+
+			fd_put(dev, fd, false);
+			*p_cache = CACHE_HIT;
+
+			return report_ioprio(start_ns, stop_ns);
+		}
+
+		// Partly cached counts as a miss - re-read it all, simplest.
+		if (rv >= 0 || errno == EAGAIN) {
+			*p_cache = CACHE_MISS;
+		}
+	}
+
+	if (! device_io(fd, false, buf, size, offset)) {
+		close(fd);
+		fprintf(stdout, "ERROR: reading %s: %d '%s'\n", dev->name, errno,
+				act_strerror(errno));
+		return -1;
+	}
+
+	uint64_t stop_ns = get_ns();
+
+	fd_put(dev, fd, false);
+
+	return report_ioprio(start_ns, stop_ns);
+}
+
+//------------------------------------------------
+// Report CPU time and cost for this interval, per
+// thread pool in use.
+//
+static void
+report_cpu()
+{
+	cpu_group* groups[] = {
+			g_cpu_generators,
+			g_cpu_transactions,
+			g_cpu_index_cache,
+			g_cpu_large_block,
+			g_cpu_shadow,
+			g_cpu_tomb_raider
+	};
+
+	for (uint32_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+		if (groups[i]->n_threads != 0) {
+			cpu_group_report(groups[i]);
+		}
+	}
+}
+
+//------------------------------------------------
+// Report achieved vs. requested rates per device,
+// if any per-device overrides are configured.
+//
+static void
+report_device_rates(double interval_sec, double factor)
+{
+	bool do_commits = g_scfg.commit_to_device && g_scfg.write_reqs_per_sec != 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+		device* dev = &g_devices[d];
+		device_counts now = {
+				.reads = histogram_get_total(dev->raw_read_hist),
+				.writes = histogram_get_total(dev->raw_write_hist),
+				.large_block_reads = atomic64_get(dev->n_large_block_reads),
+				.large_block_writes = atomic64_get(dev->n_large_block_writes)
+		};
+
+		fprintf(stdout, "achieved-per-sec %s: reads %.1lf of %.1lf", dev->name,
+				(now.reads - dev->last_counts.reads) / interval_sec,
+				g_scfg.internal_read_reqs_per_sec * factor * dev->read_share);
+
+		if (do_commits) {
+			fprintf(stdout, " writes %.1lf of %.1lf",
+					(now.writes - dev->last_counts.writes) / interval_sec,
+					g_scfg.internal_write_reqs_per_sec * factor *
+							dev->write_share);
+		}
+
+		fprintf(stdout, " large-block-reads %.1lf of %.1lf"
+				" large-block-writes %.1lf of %.1lf\n",
+				(now.large_block_reads - dev->last_counts.large_block_reads) /
+						interval_sec,
+				g_scfg.large_block_reads_per_sec * factor *
+						dev->large_block_share,
+				(now.large_block_writes - dev->last_counts.large_block_writes) /
+						interval_sec,
+				g_scfg.large_block_writes_per_sec * factor *
+						dev->large_block_share);
+
+		dev->last_counts = now;
+	}
+}
+
+//------------------------------------------------
+// Report the device write rate, amplification and
+// drive-writes-per-day implied by the configured
+// load, before the run starts.
+//
+static void
+report_endurance_projection()
+{
+	double avg_record_stored_bytes =
+			(g_scfg.record_stored_bytes + g_scfg.record_stored_bytes_rmx) / 2.0;
+
+	double client_bps = client_write_bytes_per_sec(1.0);
+	double stored_bps = g_scfg.write_reqs_per_sec * avg_record_stored_bytes;
+	double replica_bps = stored_bps * (g_scfg.replication_factor - 1);
+
+	// Data devices - commits (only in 'commit-to-device' mode) plus
+	// large-block writes. Whatever isn't record or replica writes is defrag.
+	double commit_bps =
+			g_scfg.internal_write_reqs_per_sec * avg_record_stored_bytes;
+	double large_block_bps =
+			g_scfg.large_block_writes_per_sec * g_scfg.large_block_ops_bytes;
+	double defrag_bps =
+			commit_bps + large_block_bps - (stored_bps + replica_bps);
+	double partial_flush_bps = partial_flush_bytes_per_sec();
+	double data_bps = commit_bps + large_block_bps + partial_flush_bps;
+
+	// Shadows mirror large-block writes, index devices get 4K cache writes.
+	double shadow_bps = g_scfg.num_shadows != 0 ? large_block_bps : 0.0;
+	double index_bps = (double)g_scfg.index_cache_ops_per_sec * INDEX_IO_SIZE;
+	double device_bps = data_bps + shadow_bps + index_bps;
+
+	fprintf(stdout, "\nENDURANCE PROJECTION (at configured load)\n");
+	fprintf(stdout, "client-write-MB/s: %.2lf\n", client_bps / (1024 * 1024));
+	fprintf(stdout, "device-write-MB/s: %.2lf\n", device_bps / (1024 * 1024));
+	fprintf(stdout, "  record-MB/s: %.2lf\n", stored_bps / (1024 * 1024));
+	fprintf(stdout, "  replica-MB/s: %.2lf\n", replica_bps / (1024 * 1024));
+	fprintf(stdout, "  defrag-MB/s: %.2lf\n", defrag_bps / (1024 * 1024));
+
+	if (g_scfg.flush_max_us != 0) {
+		fprintf(stdout, "  partial-flush-MB/s: %.2lf\n",
+				partial_flush_bps / (1024 * 1024));
+	}
+
+	if (g_scfg.num_shadows != 0) {
+		fprintf(stdout, "  shadow-MB/s: %.2lf\n", shadow_bps / (1024 * 1024));
+	}
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, "  index-MB/s: %.2lf\n", index_bps / (1024 * 1024));
+	}
+
+	fprintf(stdout, "write-amplification: %.2lf\n", device_bps / client_bps);
+	fprintf(stdout, "drive-writes-per-day: %.2lf\n",
+			data_bps * 86400 / total_device_bytes());
+
+	if (g_scfg.num_shadows != 0) {
+		fprintf(stdout, "shadow-drive-writes-per-day: %.2lf\n",
+				shadow_bps * 86400 / total_device_bytes());
+	}
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, "index-drive-writes-per-day: %.2lf\n",
+				index_bps * 86400 / total_index_device_bytes());
+	}
+}
+
+//------------------------------------------------
+// Warn if a request generator fell more than half
+// way to 'max-lag-sec' behind schedule in this
+// interval.
+//
+static void
+report_generator_lag()
+{
+	uint64_t lag_us = atomic64_get(g_max_generator_lag_us);
+
+	atomic64_set(&g_max_generator_lag_us, 0);
+
+	if (lag_us > g_scfg.max_lag_usec / 2) {
+		fprintf(stdout, "request-generators-lagging: %.3lf sec of max-lag-sec %"
+				PRIu64 " - try more 'service-threads'\n",
+				(double)lag_us / 1000000.0, g_scfg.max_lag_usec / 1000000);
+	}
+}
+
+//------------------------------------------------
+// Print the load sweep summary table and identify
+// the knee - the highest step at which the drive
+// still kept up.
+//
+static void
+report_load_steps()
+{
+	bool do_reads = g_scfg.read_reqs_per_sec != 0;
+	bool do_commits = g_scfg.commit_to_device && g_scfg.write_reqs_per_sec != 0;
+	const char* units = g_scfg.us_histograms ? "us" : "ms";
+
+	fprintf(stdout, "LOAD SWEEP SUMMARY\n");
+	fprintf(stdout, "(rates are per second, latencies are within %s)\n", units);
+
+	fprintf(stdout, "%4s %7s", "step", "load");
+
+	if (do_reads) {
+		fprintf(stdout, " | %10s %10s %6s %6s %6s", "reads-req", "reads",
+				"p50", "p99", "p99.9");
+	}
+
+	if (do_commits) {
+		fprintf(stdout, " | %10s %10s %6s %6s %6s", "writes-req", "writes",
+				"p50", "p99", "p99.9");
+	}
+
+	if (g_scfg.write_reqs_per_sec != 0) {
+		fprintf(stdout, " | %9s %9s %6s | %9s %9s %6s", "lb-rd-req", "lb-rd",
+				"p99", "lb-wr-req", "lb-wr", "p99");
+	}
+
+	fprintf(stdout, "\n");
+
+	int32_t knee = -1;
+	bool knee_found = false;
+
+	for (uint32_t i = 0; i < g_num_steps_done; i++) {
+		load_step* step = &g_load_steps[i];
+		double secs = (double)step->duration_us / 1000000.0;
+
+		double reads_req = g_scfg.internal_read_reqs_per_sec * step->multiplier;
+		double reads = step->reads.n_ops / secs;
+		double writes_req =
+				g_scfg.internal_write_reqs_per_sec * step->multiplier;
+		double writes = step->writes.n_ops / secs;
+		double lb_reads_req =
+				g_scfg.large_block_reads_per_sec * step->multiplier;
+		double lb_reads = step->large_block_reads.n_ops / secs;
+		double lb_writes_req =
+				g_scfg.large_block_writes_per_sec * step->multiplier;
+		double lb_writes = step->large_block_writes.n_ops / secs;
+
+		fprintf(stdout, "%4" PRIu32 " %6gx", i + 1, step->multiplier);
+
+		if (do_reads) {
+			fprintf(stdout, " | %10.1lf %10.1lf %6" PRIu64 " %6" PRIu64 " %6"
+					PRIu64, reads_req, reads, step->reads.p50,
+					step->reads.p99, step->reads.p999);
+		}
+
+		if (do_commits) {
+			fprintf(stdout, " | %10.1lf %10.1lf %6" PRIu64 " %6" PRIu64 " %6"
+					PRIu64, writes_req, writes, step->writes.p50,
+					step->writes.p99, step->writes.p999);
+		}
+
+		if (g_scfg.write_reqs_per_sec != 0) {
+			fprintf(stdout, " | %9.2lf %9.2lf %6" PRIu64 " | %9.2lf %9.2lf %6"
+					PRIu64, lb_reads_req, lb_reads,
+					step->large_block_reads.p99, lb_writes_req, lb_writes,
+					step->large_block_writes.p99);
+		}
+
+		fprintf(stdout, "\n");
+
+		if (knee_found) {
+			continue;
+		}
+
+		// Judge by client reads if there are any, otherwise by the write
+		// stream that carries the write load.
+		const stream_stats* stats = do_reads ? &step->reads :
+				(do_commits ? &step->writes : &step->large_block_writes);
+		const stream_stats* first = do_reads ? &g_load_steps[0].reads :
+				(do_commits ? &g_load_steps[0].writes :
+						&g_load_steps[0].large_block_writes);
+		double req = do_reads ? reads_req :
+				(do_commits ? writes_req : lb_writes_req);
+		double got = do_reads ? reads : (do_commits ? writes : lb_writes);
+
+		if (got < req * KNEE_MIN_RATE_FRACTION ||
+				stats->p99 > first->p99 * KNEE_MAX_P99_GROWTH) {
+			knee_found = true;
+		}
+		else {
+			knee = (int32_t)i;
+		}
+	}
+
+	if (knee < 0) {
+		fprintf(stdout, "knee: none - drive(s) didn't keep up at first step\n");
+	}
+	else if (! knee_found) {
+		fprintf(stdout, "knee: not reached - drive(s) kept up through %gx\n",
+				g_load_steps[knee].multiplier);
+	}
+	else {
+		fprintf(stdout, "knee: step %" PRId32 " (%gx) - last step achieving "
+				"%.0lf%% of requested rate with p99 within %dx of first step\n",
+				knee + 1, g_load_steps[knee].multiplier,
+				KNEE_MIN_RATE_FRACTION * 100, KNEE_MAX_P99_GROWTH);
+	}
+
+	fprintf(stdout, "\n");
+	fflush(stdout);
+}
+
+//------------------------------------------------
+// Report overload counts for this interval, and
+// adjust throttling if configured.
+//
+static void
+report_overload()
+{
+	static uint64_t last_reqs_shed = 0;
+	static uint64_t last_reqs_late = 0;
+	static uint64_t last_large_block_ops_shed = 0;
+	static uint64_t last_large_block_ops_late = 0;
+	static uint64_t last_shadow_writes_shed = 0;
+	static uint64_t last_index_cache_ops_shed = 0;
+	static uint64_t last_index_cache_ops_late = 0;
+
+	uint64_t reqs_shed = atomic64_get(g_reqs_shed);
+	uint64_t reqs_late = atomic64_get(g_reqs_late);
+	uint64_t large_block_ops_shed = atomic64_get(g_large_block_ops_shed);
+	uint64_t large_block_ops_late = atomic64_get(g_large_block_ops_late);
+
+	fprintf(stdout, "requests-shed: %" PRIu64 "\n", reqs_shed - last_reqs_shed);
+	fprintf(stdout, "requests-late: %" PRIu64 "\n", reqs_late - last_reqs_late);
+
+	if (g_scfg.write_reqs_per_sec != 0) {
+		fprintf(stdout, "large-block-ops-shed: %" PRIu64 "\n",
+				large_block_ops_shed - last_large_block_ops_shed);
+		fprintf(stdout, "large-block-ops-late: %" PRIu64 "\n",
+				large_block_ops_late - last_large_block_ops_late);
+	}
+
+	if (g_scfg.write_reqs_per_sec != 0 && g_scfg.num_shadows != 0) {
+		uint64_t shadow_writes_shed = atomic64_get(g_shadow_writes_shed);
+
+		fprintf(stdout, "shadow-writes-shed: %" PRIu64 "\n",
+				shadow_writes_shed - last_shadow_writes_shed);
+
+		last_shadow_writes_shed = shadow_writes_shed;
+	}
+
+	if (g_scfg.index_cache_ops_per_sec != 0) {
+		uint64_t index_cache_ops_shed = atomic64_get(g_index_cache_ops_shed);
+		uint64_t index_cache_ops_late = atomic64_get(g_index_cache_ops_late);
+
+		fprintf(stdout, "index-cache-ops-shed: %" PRIu64 "\n",
+				index_cache_ops_shed - last_index_cache_ops_shed);
+		fprintf(stdout, "index-cache-ops-late: %" PRIu64 "\n",
+				index_cache_ops_late - last_index_cache_ops_late);
+
+		last_index_cache_ops_shed = index_cache_ops_shed;
+		last_index_cache_ops_late = index_cache_ops_late;
+	}
+
+	last_reqs_shed = reqs_shed;
+	last_reqs_late = reqs_late;
+	last_large_block_ops_shed = large_block_ops_shed;
+	last_large_block_ops_late = large_block_ops_late;
+
+	if (g_scfg.on_overload == OVERLOAD_THROTTLE) {
+		adjust_throttle();
+		fprintf(stdout, "throttle-factor: %.3lf\n", g_throttle_factor);
+	}
+	else {
+		g_overloaded = false;
+	}
+}
+
+//------------------------------------------------
+// Report counters for this interval, per thread
+// pool in use.
+//
+static void
+report_perf()
+{
+	perf_group* groups[] = {
+			g_perf_generators,
+			g_perf_transactions
+	};
+
+	for (uint32_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+		if (atomic32_get(groups[i]->n_threads) != 0) {
+			perf_group_report(groups[i]);
+		}
+	}
+}
+
+//------------------------------------------------
+// Report the bandwidth of copies to and from the
+// mapped files for this interval.
+//
+static void
+report_pmem_bytes()
+{
+	static uint64_t last_report_us = 0;
+	static uint64_t last_read_bytes = 0;
+	static uint64_t last_write_bytes = 0;
+
+	uint64_t now_us = get_us() - g_run_start_us;
+	double interval_sec = (double)(now_us - last_report_us) / 1000000.0;
+
+	last_report_us = now_us;
+
+	uint64_t read_bytes = atomic64_get(g_pmem_read_bytes);
+	uint64_t write_bytes = atomic64_get(g_pmem_write_bytes);
+
+	fprintf(stdout, "pmem-MB/s: read %.2lf write %.2lf\n",
+			(read_bytes - last_read_bytes) / interval_sec / (1024 * 1024),
+			(write_bytes - last_write_bytes) / interval_sec / (1024 * 1024));
+
+	last_read_bytes = read_bytes;
+	last_write_bytes = write_bytes;
+}
+
+//------------------------------------------------
+// Report a stream's achieved issue rate for this
+// interval, against the rate its pacers targeted.
+// Every issued op has a lag data point, so we use
+// the lag histogram's total for the issue count.
+//
+static void
+report_rate(const char* tag, histogram* lag_hist, uint64_t* p_last_total,
+		double requested_per_sec, double interval_sec)
+{
+	uint64_t total = histogram_get_total(lag_hist);
+
+	fprintf(stdout, "achieved-%s-per-sec: %.1lf of %.1lf\n", tag,
+			(double)(total - *p_last_total) / interval_sec, requested_per_sec);
+
+	*p_last_total = total;
+}
+
+//------------------------------------------------
+// Report achieved vs. requested issue rates for
+// this interval. Called before any load factor
+// changes, so load_factor() is what applied over
+// the interval.
+//
+static void
+report_rates()
+{
+	static uint64_t last_report_us = 0;
+	static uint64_t last_reads = 0;
+	static uint64_t last_writes = 0;
+	static uint64_t last_large_block_reads = 0;
+	static uint64_t last_large_block_writes = 0;
+	static uint64_t last_index_cache_ops = 0;
+
+	uint64_t now_us = get_us() - g_run_start_us;
+	double interval_sec = (double)(now_us - last_report_us) / 1000000.0;
+	double factor = load_factor();
+
+	last_report_us = now_us;
+
+	if (interval_sec <= 0.0) {
+		return;
+	}
+
+	if (g_scfg.read_reqs_per_sec != 0) {
+		report_rate("reads", g_lag_read_hist, &last_reads,
+				g_scfg.internal_read_reqs_per_sec * factor, interval_sec);
+	}
+
+	if (g_scfg.commit_to_device && g_scfg.write_reqs_per_sec != 0) {
+		report_rate("writes", g_lag_write_hist, &last_writes,
+				g_scfg.internal_write_reqs_per_sec * factor, interval_sec);
+	}
+
+	if (g_scfg.write_reqs_per_sec != 0) {
+		report_rate("large-block-reads", g_lag_large_block_read_hist,
+				&last_large_block_reads,
+				g_scfg.large_block_reads_per_sec * factor, interval_sec);
+		report_rate("large-block-writes", g_lag_large_block_write_hist,
+				&last_large_block_writes,
+				g_scfg.large_block_writes_per_sec * factor, interval_sec);
+	}
+
+	if (g_scfg.index_cache_ops_per_sec != 0) {
+		report_rate("index-cache-ops", g_lag_index_cache_hist,
+				&last_index_cache_ops,
+				g_scfg.index_cache_ops_per_sec * factor, interval_sec);
+	}
+
+	if (g_scfg.per_device_rates) {
+		report_device_rates(interval_sec, factor);
+	}
+}
+
+//------------------------------------------------
+// Report how many large-block writes are waiting
+// to be mirrored, flagging a growing backlog.
+//
+static void
+report_shadow_backlog()
+{
+	static uint32_t last_queued = 0;
+
+	uint32_t queued = 0;
+
+	for (uint32_t d = 0; d < g_scfg.num_data_devices; d++) {
+		queued += queue_sz(g_devices[d].shadow_q);
+	}
+
+	fprintf(stdout, "shadow-writes-queued: %" PRIu32 "%s\n", queued,
+			queued > last_queued && queued > g_scfg.num_data_devices ?
+					" - falling behind" : "");
+
+	last_queued = queued;
+}
+
+//------------------------------------------------
+// Report how many transaction requests were taken
+// from other threads' queues in this interval.
+//
+static void
+report_steals()
+{
+	static uint64_t last_reqs_stolen = 0;
+
+	uint64_t reqs_stolen = atomic64_get(g_reqs_stolen);
+
+	fprintf(stdout, "requests-stolen: %" PRIu64 "\n",
+			reqs_stolen - last_reqs_stolen);
+
+	last_reqs_stolen = reqs_stolen;
+}
+
+//------------------------------------------------
+// Report bytes written to the device(s) in this
+// interval, per stream, against the logical client
+// write bytes, and the drive-writes-per-day this
+// rate implies for each kind of device. Called
+// before any load factor changes.
+//
+static void
+report_write_bytes()
+{
+	static uint64_t last_report_us = 0;
+	static uint64_t last_commit_bytes = 0;
+	static uint64_t last_large_block_bytes = 0;
+	static uint64_t last_partial_flush_bytes = 0;
+	static uint64_t last_shadow_bytes = 0;
+	static uint64_t last_index_bytes = 0;
+
+	uint64_t now_us = get_us() - g_run_start_us;
+	double interval_sec = (double)(now_us - last_report_us) / 1000000.0;
+
+	last_report_us = now_us;
+
+	uint64_t commit_bytes = atomic64_get(g_commit_write_bytes);
+	uint64_t large_block_bytes = atomic64_get(g_large_block_write_bytes);
+	uint64_t partial_flush_bytes = atomic64_get(g_partial_flush_write_bytes);
+	uint64_t shadow_bytes = atomic64_get(g_shadow_write_bytes);
+	uint64_t index_bytes = atomic64_get(g_index_write_bytes);
+
+	double commit_bps = (commit_bytes - last_commit_bytes) / interval_sec;
+	double large_block_bps =
+			(large_block_bytes - last_large_block_bytes) / interval_sec;
+	double partial_flush_bps =
+			(partial_flush_bytes - last_partial_flush_bytes) / interval_sec;
+	double shadow_bps = (shadow_bytes - last_shadow_bytes) / interval_sec;
+	double index_bps = (index_bytes - last_index_bytes) / interval_sec;
+	double data_bps = commit_bps + large_block_bps + partial_flush_bps;
+	double device_bps = data_bps + shadow_bps + index_bps;
+	double client_bps = client_write_bytes_per_sec(load_factor());
+
+	last_commit_bytes = commit_bytes;
+	last_large_block_bytes = large_block_bytes;
+	last_partial_flush_bytes = partial_flush_bytes;
+	last_shadow_bytes = shadow_bytes;
+	last_index_bytes = index_bytes;
+
+	// In 'commit-to-device' mode, records are committed individually and
+	// large-block writes are only defrag.
+	fprintf(stdout, "write-MB/s: client %.2lf device %.2lf (%s %.2lf",
+			client_bps / (1024 * 1024), device_bps / (1024 * 1024),
+			g_scfg.commit_to_device ? "defrag" : "large-block",
+			large_block_bps / (1024 * 1024));
+
+	if (g_scfg.commit_to_device) {
+		fprintf(stdout, " commit %.2lf", commit_bps / (1024 * 1024));
+	}
+
+	if (g_scfg.flush_max_us != 0) {
+		fprintf(stdout, " partial-flush %.2lf",
+				partial_flush_bps / (1024 * 1024));
+	}
+
+	if (g_scfg.num_shadows != 0) {
+		fprintf(stdout, " shadow %.2lf", shadow_bps / (1024 * 1024));
+	}
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, " index %.2lf", index_bps / (1024 * 1024));
+	}
+
+	fprintf(stdout, ") amplification %.2lf drive-writes-per-day %.2lf",
+			client_bps == 0.0 ? 0.0 : device_bps / client_bps,
+			data_bps * 86400 / total_device_bytes());
+
+	if (g_scfg.num_shadows != 0) {
+		fprintf(stdout, " shadow %.2lf",
+				shadow_bps * 86400 / total_device_bytes());
+	}
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, " index %.2lf",
+				index_bps * 86400 / total_index_device_bytes());
+	}
+
+	fprintf(stdout, "\n");
+}
+
+//------------------------------------------------
+// Body of every transaction coroutine - does each
+// request it's handed, yielding while its IO is in
+// flight, then yields as idle.
+//
+static void
+run_trans_coroutine(void* pv_tc)
+{
+	trans_coroutine* tc = (trans_coroutine*)pv_tc;
+
+	// Never returns - idle coroutines are simply destroyed at the end.
+	while (true) {
+		do_transaction(&tc->req, tc->buf);
+
+		tc->busy = false;
+		coroutine_yield();
+	}
+}
+
+//------------------------------------------------
+// Run a transaction thread as a scheduler for its
+// coroutines - hand each idle one a request, and
+// resume each busy one when its IO completes.
+//
+static void
+schedule_trans_coroutines(queue* req_q, uint32_t q_index, uint32_t slot)
+{
+	uint32_t n_cos = g_scfg.coroutines_per_thread;
+
+	if (! async_io_setup(n_cos, &tl_aio_ctx)) {
+		exit(-1);
+	}
+
+	uint32_t buf_size = max_trans_req_bytes();
+	trans_coroutine* tcs = calloc(n_cos, sizeof(trans_coroutine));
+	trans_coroutine** idle = malloc(n_cos * sizeof(trans_coroutine*));
+	struct io_event* events = malloc(n_cos * sizeof(struct io_event));
+
+	if (! tcs || ! idle || ! events) {
+		fprintf(stdout, "ERROR: creating transaction coroutines (malloc)\n");
+		exit(-1);
+	}
+
+	for (uint32_t i = 0; i < n_cos; i++) {
+		trans_coroutine* tc = &tcs[i];
+
+		if (! (tc->buf = act_valloc(buf_size))) {
+			fprintf(stdout, "ERROR: coroutine buffer act_valloc()\n");
+			exit(-1);
+		}
+
+		if (! (tc->co = coroutine_create(COROUTINE_STACK_SIZE,
+				run_trans_coroutine, tc))) {
+			exit(-1);
+		}
+
+		idle[i] = tc;
+	}
+
+	uint32_t n_idle = n_cos;
+	struct timespec poll = { .tv_sec = 0, .tv_nsec = COROUTINE_POLL_NS };
+
+	// Once stopped, finish everything in flight.
+	while (g_running || n_idle != n_cos) {
+		bool active = trans_thread_active(slot);
+
+		// Not needed by the adaptive pool right now.
+		if (! active && n_idle == n_cos) {
+			usleep(TRANS_PARK_US);
+			continue;
+		}
+
+		// Block (briefly) for a request only if there's no IO to reap.
+		while (active && g_running && n_idle != 0 &&
+				pop_trans_req(req_q, q_index, &idle[n_idle - 1]->req,
+						n_idle == n_cos ? 100 : QUEUE_NO_WAIT)) {
+			trans_coroutine* tc = idle[--n_idle];
+
+			tc->busy = true;
+			resume_trans_coroutine(tc);
+
+			if (! tc->busy) {
+				idle[n_idle++] = tc;
+			}
+		}
+
+		if (n_idle == n_cos) {
+			continue;
+		}
+
+		int n = async_io_reap(tl_aio_ctx, 1, n_cos - n_idle, events,
+				n_idle == 0 || ! g_running ? NULL : &poll);
+
+		if (n < 0) {
+			// Can't know what's still in flight - can't carry on.
+			fprintf(stdout, "ERROR: io_getevents: %d '%s'\n", errno,
+					act_strerror(errno));
+			fprintf(stdout, "test stopped\n");
+			exit(-1);
+		}
+
+		for (int e = 0; e < n; e++) {
+			trans_coroutine* tc = (trans_coroutine*)(uintptr_t)events[e].data;
+
+			tc->io_res = events[e].res;
+			resume_trans_coroutine(tc);
+
+			if (! tc->busy) {
+				idle[n_idle++] = tc;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < n_cos; i++) {
+		coroutine_destroy(tcs[i].co);
+		free(tcs[i].buf);
+	}
+
+	free(events);
+	free(idle);
+	free(tcs);
+
+	async_io_destroy(tl_aio_ctx);
+}
+
+//------------------------------------------------
+// Set the calling thread's IO priority, and find
+// its latency histogram.
+//
+static void
+set_thread_ioprio(int ioprio)
+{
+	if (g_num_ioprio_hists == 0) {
+		return;
+	}
+
+	ioprio_set_self(ioprio);
+
+	for (uint32_t i = 0; i < g_num_ioprio_hists; i++) {
+		if (g_ioprio_hists[i].ioprio == ioprio) {
+			tl_ioprio_hist = g_ioprio_hists[i].hist;
+			return;
+		}
+	}
+}
+
+//------------------------------------------------
+// If configured to, skip ahead when an op stream
+// lags too far behind, and count the skipped ops
+// as shed. Returns false if we should stop the
+// test instead.
+//
+static bool
+shed_lag(pacer* pace, atomic64* n_shed)
+{
+	if (g_scfg.on_overload == OVERLOAD_STOP) {
+		return false;
+	}
+
+	atomic64_add(n_shed, (int64_t)pacer_skip(pace));
+	g_overloaded = true;
+
+	return true;
+}
+
+//------------------------------------------------
+// If configured to, drop a request that would
+// exceed max-reqs-queued, and count it as shed.
+// Returns false if we should stop the test
+// instead.
+//
+static bool
+shed_req()
+{
+	if (g_scfg.on_overload == OVERLOAD_STOP) {
+		return false;
+	}
+
+	atomic32_decr(&g_reqs_queued);
+	atomic64_incr(&g_reqs_shed);
+	g_overloaded = true;
+
+	return true;
+}
+
+//------------------------------------------------
+// Start a device's large-block threads of one
+// kind, sharing the device's pace between them.
+//
+static bool
+start_large_block_stream(device* dev, large_block_stream* stream,
+		double ops_per_sec, void* (*run)(void*))
+{
+	pthread_mutex_init(&stream->lock, NULL);
+	pacer_init(&stream->pace, g_run_start_us,
+			ops_per_sec * dev->large_block_share, load_factor());
+
+	stream->tids = malloc(g_scfg.large_block_threads * sizeof(pthread_t));
+
+	if (! stream->tids) {
+		return false;
+	}
+
+	for (uint32_t t = 0; t < g_scfg.large_block_threads; t++) {
+		if (pthread_create(&stream->tids[t], NULL, run, (void*)dev) != 0 ||
+				! cpu_group_add(g_cpu_large_block, stream->tids[t])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Try, without blocking, to pop a request from a
+// queue other than our own. Start at a random
+// queue so idle threads don't all pile onto the
+// same victim.
+//
+static bool
+steal_req(uint32_t own_q_index, trans_req* req)
+{
+	uint32_t num_queues = g_scfg.num_queues;
+
+	if (num_queues < 2) {
+		return false;
+	}
+
+	uint32_t start = rand_32() % num_queues;
+
+	for (uint32_t n = 0; n < num_queues; n++) {
+		uint32_t q_index = (start + n) % num_queues;
+
+		if (q_index != own_q_index &&
+				queue_pop(g_trans_qs[q_index], (void*)req, QUEUE_NO_WAIT) ==
+						QUEUE_OK) {
+			atomic64_incr(&g_reqs_stolen);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------
+// Get a stream's results since the last call, for
+// the current load step.
+//
+static void
+step_stats(histogram* h, uint64_t* start_counts, stream_stats* stats)
+{
+	uint64_t counts[N_BUCKETS];
+
+	histogram_get_counts(h, counts);
+	stats->n_ops = 0;
+
+	for (uint32_t b = 0; b < N_BUCKETS; b++) {
+		uint64_t now_count = counts[b];
+
+		counts[b] -= start_counts[b];
+		start_counts[b] = now_count;
+		stats->n_ops += counts[b];
+	}
+
+	stats->p50 = histogram_percentile(counts, 50.0);
+	stats->p99 = histogram_percentile(counts, 99.0);
+	stats->p999 = histogram_percentile(counts, 99.9);
+}
+
+//------------------------------------------------
+// Wait for a device's large-block threads of one
+// kind to finish.
+//
+static void
+stop_large_block_stream(large_block_stream* stream)
+{
+	for (uint32_t t = 0; t < g_scfg.large_block_threads; t++) {
+		pthread_join(stream->tids[t], NULL);
+	}
+
+	free(stream->tids);
+	pthread_mutex_destroy(&stream->lock);
+}
+
+//------------------------------------------------
+// Do one transaction write operation and report.
+//
+static void
+write_and_report(trans_req* write_req, uint8_t* buf)
+{
+	// Salt each record.
+	rand_fill(buf, write_req->size);
+
+	uint64_t raw_start_time = get_ns();
+	uint64_t stop_time = write_to_device(write_req->dev, write_req->offset,
+			write_req->size, buf);
+
+	if (stop_time != -1) {
+		histogram_insert_data_point(g_raw_write_hist,
+				safe_delta_ns(raw_start_time, stop_time));
+		histogram_insert_data_point(g_write_hist,
+				safe_delta_ns(write_req->start_time, stop_time));
+		histogram_insert_data_point(write_req->dev->raw_write_hist,
+				safe_delta_ns(raw_start_time, stop_time));
+		atomic64_add(&g_commit_write_bytes, write_req->size);
+	}
+}
+
+//------------------------------------------------
+// Do one large block write operation and report.
+//
+static void
+write_and_report_large_block(device* dev, uint8_t* buf)
+{
+	// Salt the block each time.
+	rand_fill(buf, g_scfg.large_block_ops_bytes);
+
+	uint64_t offset = random_large_block_offset(dev);
+	uint64_t start_time = get_ns();
+	uint64_t stop_time = large_block_io(dev, offset, buf, true);
+
+	if (stop_time != -1) {
+		histogram_insert_data_point(g_large_block_write_hist,
+				safe_delta_ns(start_time, stop_time));
+		atomic64_add(&g_large_block_write_bytes, g_scfg.large_block_ops_bytes);
+		atomic64_incr(&dev->n_large_block_writes);
+		record_recent_write(dev, offset);
+
+		if (g_scfg.num_shadows != 0) {
+			queue_shadow_write(dev, offset);
+		}
+	}
+}
+
+//------------------------------------------------
+// Do one device write operation.
+//
+static uint64_t
+write_to_device(device* dev, uint64_t offset, uint32_t size, const uint8_t* buf)
+{
+	uint64_t start_ns = tl_ioprio_hist != NULL ? get_ns() : 0;
+
+	if (g_scfg.pmem) {
+		pmem_write(dev->pmem_base + offset, buf, size, g_scfg.pmem_persist);
+		atomic64_add(&g_pmem_write_bytes, size);
+
+		return report_ioprio(start_ns, get_ns());
+	}
+
+	int fd = fd_get(dev, true);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (! device_io(fd, true, (uint8_t*)buf, size, offset)) {
+		close(fd);
+		fprintf(stdout, "ERROR: writing %s: %d '%s'\n", dev->name, errno,
+				act_strerror(errno));
+		return -1;
+	}
+
+	if (buffered_io() && g_scfg.file_sync_range != SYNC_RANGE_NONE) {
+		unsigned int flags = g_scfg.file_sync_range == SYNC_RANGE_START ?
+				SYNC_FILE_RANGE_WRITE :
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+						SYNC_FILE_RANGE_WAIT_AFTER;
+
+		if (sync_file_range(fd, (off_t)offset, size, flags) != 0) {
+			close(fd);
+			fprintf(stdout, "ERROR: sync range %s: %d '%s'\n", dev->name,
+					errno, act_strerror(errno));
+			return -1;
+		}
+	}
+
+	uint64_t stop_ns = get_ns();
+
+	fd_put(dev, fd, true);
+
+	return report_ioprio(start_ns, stop_ns);
 }
@@ -29,15 +29,24 @@
 #include "cfg_storage.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 
 #include "common/cfg.h"
+#include "common/clock.h"
 #include "common/hardware.h"
+#include "common/histogram.h"
+#include "common/ioprio.h"
+#include "common/queue.h"
+#include "common/random.h"
 #include "common/trace.h"
 
 
@@ -46,18 +55,46 @@
 //
 
 static const char TAG_DEVICE_NAMES[]            = "device-names";
+static const char TAG_DEVICE_ROLES[]            = "device-roles";
+static const char TAG_SHADOW_DEVICE_NAMES[]     = "shadow-device-names";
+static const char TAG_DEVICE_READ_MULTIPLIERS[] = "device-read-multipliers";
+static const char TAG_DEVICE_WRITE_MULTIPLIERS[] = "device-write-multipliers";
+static const char TAG_DEVICE_LARGE_BLOCK_MULTIPLIERS[] =
+		"device-large-block-multipliers";
+static const char TAG_DEVICE_RECORD_BYTES[]     = "device-record-bytes";
 static const char TAG_FILE_SIZE_MBYTES[]        = "file-size-mbytes";
+static const char TAG_FILE_DIRECT_IO[]          = "file-direct-io";
+static const char TAG_FILE_FADVISE[]            = "file-fadvise";
+static const char TAG_FILE_SYNC_RANGE[]         = "file-sync-range";
+static const char TAG_FILE_DROP_CACHE[]         = "file-drop-cache";
+static const char TAG_PMEM[]                    = "pmem";
+static const char TAG_PMEM_PERSIST[]            = "pmem-persist";
 static const char TAG_SERVICE_THREADS[]         = "service-threads";
 static const char TAG_NUM_QUEUES[]              = "num-queues";
 static const char TAG_THREADS_PER_QUEUE[]       = "threads-per-queue";
+static const char TAG_THREADS_PER_QUEUE_MAX[]   = "threads-per-queue-max";
+static const char TAG_QUEUE_WAIT_TARGET_USEC[]  = "queue-wait-target-usec";
+static const char TAG_WORK_STEALING[]           = "work-stealing";
+static const char TAG_COROUTINES_PER_THREAD[]   = "coroutines-per-thread";
+static const char TAG_QUEUE_PARK[]              = "queue-park";
+static const char TAG_QUEUE_SPIN_USEC[]         = "queue-spin-usec";
+static const char TAG_CACHE_THREADS[]           = "cache-threads";
 static const char TAG_TEST_DURATION_SEC[]       = "test-duration-sec";
 static const char TAG_REPORT_INTERVAL_SEC[]     = "report-interval-sec";
 static const char TAG_MICROSECOND_HISTOGRAMS[]  = "microsecond-histograms";
+static const char TAG_PERF_COUNTERS[]           = "perf-counters";
 static const char TAG_READ_REQS_PER_SEC[]       = "read-reqs-per-sec";
 static const char TAG_WRITE_REQS_PER_SEC[]      = "write-reqs-per-sec";
 static const char TAG_RECORD_BYTES[]            = "record-bytes";
 static const char TAG_RECORD_BYTES_RANGE_MAX[]  = "record-bytes-range-max";
+static const char TAG_RECENT_READ_PCT[]         = "recent-read-pct";
+static const char TAG_RECENT_READ_HALF_LIFE[]   = "recent-read-half-life";
+static const char TAG_RECENT_RING_SIZE[]        = "recent-ring-size";
 static const char TAG_LARGE_BLOCK_OP_KBYTES[]   = "large-block-op-kbytes";
+static const char TAG_LARGE_BLOCK_THREADS[]     = "large-block-threads";
+static const char TAG_LARGE_BLOCK_CHUNK_KBYTES[] = "large-block-chunk-kbytes";
+static const char TAG_LARGE_BLOCK_CHUNK_MODE[]  = "large-block-chunk-mode";
+static const char TAG_FLUSH_MAX_MS[]            = "flush-max-ms";
 static const char TAG_REPLICATION_FACTOR[]      = "replication-factor";
 static const char TAG_UPDATE_PCT[]              = "update-pct";
 static const char TAG_DEFRAG_LWM_PCT[]          = "defrag-lwm-pct";
@@ -67,19 +104,110 @@ static const char TAG_COMMIT_MIN_BYTES[]        = "commit-min-bytes";
 static const char TAG_TOMB_RAIDER[]             = "tomb-raider";
 static const char TAG_TOMB_RAIDER_SLEEP_USEC[]  = "tomb-raider-sleep-usec";
 static const char TAG_MAX_REQS_QUEUED[]         = "max-reqs-queued";
+static const char TAG_MAX_SHADOW_WRITES_QUEUED[] = "max-shadow-writes-queued";
 static const char TAG_MAX_LAG_SEC[]             = "max-lag-sec";
+static const char TAG_ON_OVERLOAD[]             = "on-overload";
 static const char TAG_SCHEDULER_MODE[]          = "scheduler-mode";
+static const char TAG_TRANSACTION_IOPRIO[]      = "transaction-ioprio";
+static const char TAG_LARGE_BLOCK_IOPRIO[]      = "large-block-ioprio";
+static const char TAG_TOMB_RAIDER_IOPRIO[]      = "tomb-raider-ioprio";
+static const char TAG_CACHE_IOPRIO[]            = "cache-ioprio";
+static const char TAG_LOAD_MULTIPLIERS[]        = "load-multipliers";
+static const char TAG_LOAD_STEP_SEC[]           = "load-step-sec";
 
 #define RBLOCK_SIZE 16 // must be power of 2
 
+typedef struct fadvise_mode_s {
+	const char* name;
+	int advice;
+} fadvise_mode;
+
+static const fadvise_mode FADVISE_MODES[] = {
+	{ "none", -1 }, // default
+	{ "normal", POSIX_FADV_NORMAL },
+	{ "random", POSIX_FADV_RANDOM },
+	{ "sequential", POSIX_FADV_SEQUENTIAL },
+	{ "willneed", POSIX_FADV_WILLNEED },
+	{ "dontneed", POSIX_FADV_DONTNEED },
+	{ "noreuse", POSIX_FADV_NOREUSE }
+};
+
+static const uint32_t N_FADVISE_MODES =
+		(uint32_t)(sizeof(FADVISE_MODES) / sizeof(fadvise_mode));
+
+// Indexed by chunk_mode.
+static const char* const CHUNK_MODES[] = {
+	"parallel", // default
+	"sequential"
+};
+
+static const uint32_t N_CHUNK_MODES =
+		(uint32_t)(sizeof(CHUNK_MODES) / sizeof(const char*));
+
+// Indexed by queue_park_mode.
+static const char* const QUEUE_PARK_MODES[] = {
+	"condvar", // default
+	"futex"
+};
+
+static const uint32_t N_QUEUE_PARK_MODES =
+		(uint32_t)(sizeof(QUEUE_PARK_MODES) / sizeof(const char*));
+
+// Indexed by device_role.
+static const char* const DEVICE_ROLES[] = {
+	"data", // default
+	"index",
+	"both"
+};
+
+static const uint32_t N_DEVICE_ROLES =
+		(uint32_t)(sizeof(DEVICE_ROLES) / sizeof(const char*));
+
+// Indexed by sync_range_mode.
+static const char* const SYNC_RANGE_MODES[] = {
+	"none", // default
+	"start",
+	"wait"
+};
+
+static const uint32_t N_SYNC_RANGE_MODES =
+		(uint32_t)(sizeof(SYNC_RANGE_MODES) / sizeof(const char*));
+
+// Indexed by pmem_persist_mode.
+static const char* const PMEM_PERSIST_MODES[] = {
+	"none",
+	"nt", // default
+	"clwb"
+};
+
+static const uint32_t N_PMEM_PERSIST_MODES =
+		(uint32_t)(sizeof(PMEM_PERSIST_MODES) / sizeof(const char*));
+
+// Auto service-threads - time a request generator for this long, then plan to
+// run each at no more than this fraction of the rate it managed.
+#define CALIBRATION_US (200 * 1000)
+#define GENERATOR_HEADROOM 0.5
+
 
 //==========================================================
 // Forward declarations.
 //
 
+static double calibrate_generator_reqs_per_sec();
 static bool check_configuration();
 static bool derive_configuration();
+static double derive_device_shares(const double mults[], uint32_t num_mults,
+		double shares[]);
+static bool derive_service_threads(uint64_t total_reqs_per_sec);
 static void echo_configuration();
+static const char* fadvise_name(int advice);
+static chunk_mode parse_chunk_mode();
+static void parse_device_roles();
+static int parse_fadvise();
+static pmem_persist_mode parse_pmem_persist_mode();
+static queue_park_mode parse_queue_park_mode();
+static sync_range_mode parse_sync_range_mode();
+static void* run_calibration_drain(void* pv_q);
 
 
 //==========================================================
@@ -90,14 +218,23 @@ static void echo_configuration();
 storage_cfg g_scfg = {
 		.service_threads = 1,
 		.threads_per_queue = 4,
+		.queue_wait_target_us = 1000,
+		.cache_threads = 8,
 		.report_interval_us = 1000000,
 		.record_bytes = 1536,
+		.recent_read_half_life = 64,
+		.recent_ring_size = 4096,
 		.large_block_ops_bytes = 1024 * 128,
+		.large_block_threads = 1,
 		.replication_factor = 1,
 		.defrag_lwm_pct = 50,
 		.max_reqs_queued = 100000,
+		.max_shadow_writes_queued = 256,
 		.max_lag_usec = 1000000 * 10,
-		.scheduler_mode = "noop"
+		.scheduler_mode = "noop",
+		.file_fadvise = -1,
+		.pmem_persist = PMEM_PERSIST_NT,
+		.load_step_us = 1000000 * 60
 };
 
 
@@ -157,9 +294,52 @@ storage_configure(int argc, char* argv[])
 			parse_device_names(MAX_NUM_STORAGE_DEVICES, g_scfg.device_names,
 					&g_scfg.num_devices);
 		}
+		else if (strcmp(tag, TAG_DEVICE_ROLES) == 0) {
+			parse_device_roles();
+		}
+		else if (strcmp(tag, TAG_SHADOW_DEVICE_NAMES) == 0) {
+			parse_device_names(MAX_NUM_STORAGE_DEVICES, g_scfg.shadow_names,
+					&g_scfg.num_shadows);
+		}
+		else if (strcmp(tag, TAG_DEVICE_READ_MULTIPLIERS) == 0) {
+			parse_double_list(MAX_NUM_STORAGE_DEVICES,
+					g_scfg.device_read_mults, &g_scfg.num_read_mults);
+		}
+		else if (strcmp(tag, TAG_DEVICE_WRITE_MULTIPLIERS) == 0) {
+			parse_double_list(MAX_NUM_STORAGE_DEVICES,
+					g_scfg.device_write_mults, &g_scfg.num_write_mults);
+		}
+		else if (strcmp(tag, TAG_DEVICE_LARGE_BLOCK_MULTIPLIERS) == 0) {
+			parse_double_list(MAX_NUM_STORAGE_DEVICES,
+					g_scfg.device_large_block_mults,
+					&g_scfg.num_large_block_mults);
+		}
+		else if (strcmp(tag, TAG_DEVICE_RECORD_BYTES) == 0) {
+			parse_uint32_list(MAX_NUM_STORAGE_DEVICES,
+					g_scfg.device_record_bytes,
+					&g_scfg.num_device_record_bytes);
+		}
 		else if (strcmp(tag, TAG_FILE_SIZE_MBYTES) == 0) {
 			g_scfg.file_size = (uint64_t)parse_uint32() << 20;
 		}
+		else if (strcmp(tag, TAG_FILE_DIRECT_IO) == 0) {
+			g_scfg.file_direct_io = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_FILE_FADVISE) == 0) {
+			g_scfg.file_fadvise = parse_fadvise();
+		}
+		else if (strcmp(tag, TAG_FILE_SYNC_RANGE) == 0) {
+			g_scfg.file_sync_range = parse_sync_range_mode();
+		}
+		else if (strcmp(tag, TAG_FILE_DROP_CACHE) == 0) {
+			g_scfg.file_drop_cache = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_PMEM) == 0) {
+			g_scfg.pmem = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_PMEM_PERSIST) == 0) {
+			g_scfg.pmem_persist = parse_pmem_persist_mode();
+		}
 		else if (strcmp(tag, TAG_SERVICE_THREADS) == 0) {
 			g_scfg.service_threads = parse_uint32();
 		}
@@ -169,6 +349,27 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_THREADS_PER_QUEUE) == 0) {
 			g_scfg.threads_per_queue = parse_uint32();
 		}
+		else if (strcmp(tag, TAG_THREADS_PER_QUEUE_MAX) == 0) {
+			g_scfg.threads_per_queue_max = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_QUEUE_WAIT_TARGET_USEC) == 0) {
+			g_scfg.queue_wait_target_us = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_WORK_STEALING) == 0) {
+			g_scfg.work_stealing = parse_yes_no();
+		}
+		else if (strcmp(tag, TAG_COROUTINES_PER_THREAD) == 0) {
+			g_scfg.coroutines_per_thread = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_QUEUE_PARK) == 0) {
+			g_scfg.queue_park = parse_queue_park_mode();
+		}
+		else if (strcmp(tag, TAG_QUEUE_SPIN_USEC) == 0) {
+			g_scfg.queue_spin_us = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_CACHE_THREADS) == 0) {
+			g_scfg.cache_threads = parse_uint32();
+		}
 		else if (strcmp(tag, TAG_TEST_DURATION_SEC) == 0) {
 			g_scfg.run_us = (uint64_t)parse_uint32() * 1000000;
 		}
@@ -178,6 +379,9 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MICROSECOND_HISTOGRAMS) == 0) {
 			g_scfg.us_histograms = parse_yes_no();
 		}
+		else if (strcmp(tag, TAG_PERF_COUNTERS) == 0) {
+			g_scfg.perf_counters = parse_yes_no();
+		}
 		else if (strcmp(tag, TAG_READ_REQS_PER_SEC) == 0) {
 			g_scfg.read_reqs_per_sec = parse_uint32();
 		}
@@ -190,9 +394,30 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_RECORD_BYTES_RANGE_MAX) == 0) {
 			g_scfg.record_bytes_rmx = parse_uint32();
 		}
+		else if (strcmp(tag, TAG_RECENT_READ_PCT) == 0) {
+			g_scfg.recent_read_pct = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_RECENT_READ_HALF_LIFE) == 0) {
+			g_scfg.recent_read_half_life = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_RECENT_RING_SIZE) == 0) {
+			g_scfg.recent_ring_size = parse_uint32();
+		}
 		else if (strcmp(tag, TAG_LARGE_BLOCK_OP_KBYTES) == 0) {
 			g_scfg.large_block_ops_bytes = parse_uint32() * 1024;
 		}
+		else if (strcmp(tag, TAG_LARGE_BLOCK_THREADS) == 0) {
+			g_scfg.large_block_threads = parse_uint32();
+		}
+		else if (strcmp(tag, TAG_LARGE_BLOCK_CHUNK_KBYTES) == 0) {
+			g_scfg.large_block_chunk_bytes = parse_uint32() * 1024;
+		}
+		else if (strcmp(tag, TAG_LARGE_BLOCK_CHUNK_MODE) == 0) {
+			g_scfg.large_block_chunk_mode = parse_chunk_mode();
+		}
+		else if (strcmp(tag, TAG_FLUSH_MAX_MS) == 0) {
+			g_scfg.flush_max_us = (uint64_t)parse_uint32() * 1000;
+		}
 		else if (strcmp(tag, TAG_REPLICATION_FACTOR) == 0) {
 			g_scfg.replication_factor = parse_uint32();
 		}
@@ -220,12 +445,37 @@ storage_configure(int argc, char* argv[])
 		else if (strcmp(tag, TAG_MAX_REQS_QUEUED) == 0) {
 			g_scfg.max_reqs_queued = parse_uint32();
 		}
+		else if (strcmp(tag, TAG_MAX_SHADOW_WRITES_QUEUED) == 0) {
+			g_scfg.max_shadow_writes_queued = parse_uint32();
+		}
 		else if (strcmp(tag, TAG_MAX_LAG_SEC) == 0) {
 			g_scfg.max_lag_usec = (uint64_t)parse_uint32() * 1000000;
 		}
+		else if (strcmp(tag, TAG_ON_OVERLOAD) == 0) {
+			g_scfg.on_overload = parse_overload_mode();
+		}
 		else if (strcmp(tag, TAG_SCHEDULER_MODE) == 0) {
 			g_scfg.scheduler_mode = parse_scheduler_mode();
 		}
+		else if (strcmp(tag, TAG_TRANSACTION_IOPRIO) == 0) {
+			g_scfg.transaction_ioprio = parse_ioprio();
+		}
+		else if (strcmp(tag, TAG_LARGE_BLOCK_IOPRIO) == 0) {
+			g_scfg.large_block_ioprio = parse_ioprio();
+		}
+		else if (strcmp(tag, TAG_TOMB_RAIDER_IOPRIO) == 0) {
+			g_scfg.tomb_raider_ioprio = parse_ioprio();
+		}
+		else if (strcmp(tag, TAG_CACHE_IOPRIO) == 0) {
+			g_scfg.cache_ioprio = parse_ioprio();
+		}
+		else if (strcmp(tag, TAG_LOAD_MULTIPLIERS) == 0) {
+			parse_double_list(MAX_NUM_LOAD_STEPS, g_scfg.load_multipliers,
+					&g_scfg.num_load_steps);
+		}
+		else if (strcmp(tag, TAG_LOAD_STEP_SEC) == 0) {
+			g_scfg.load_step_us = (uint64_t)parse_uint32() * 1000000;
+		}
 		else {
 			fprintf(stdout, "ERROR: ignoring unknown config item '%s'\n", tag);
 		}
@@ -247,6 +497,64 @@ storage_configure(int argc, char* argv[])
 // Local helpers.
 //
 
+// Measure how many requests per second one request generator thread can make,
+// time-stamp and push round-robin to the configured queues, while other threads
+// pop them.
+static double
+calibrate_generator_reqs_per_sec()
+{
+	uint32_t num_queues = g_scfg.num_queues;
+	queue* qs[num_queues];
+	pthread_t tids[num_queues];
+	histogram* lag_hist = histogram_create(HIST_MICROSECONDS);
+
+	if (! lag_hist) {
+		return 0.0;
+	}
+
+	rand_seed_thread();
+
+	for (uint32_t i = 0; i < num_queues; i++) {
+		if (! (qs[i] = queue_create(sizeof(trans_req), true)) ||
+				pthread_create(&tids[i], NULL, run_calibration_drain,
+						(void*)qs[i]) != 0) {
+			fprintf(stdout, "ERROR: service-threads calibration setup\n");
+			exit(-1);
+		}
+	}
+
+	uint64_t start_us = get_us();
+	uint64_t now_us = start_us;
+	uint64_t n_reqs = 0;
+
+	while (now_us - start_us < CALIBRATION_US) {
+		trans_req req = {
+				.offset = rand_64(),
+				.size = rand_32(),
+				.start_time = get_ns()
+		};
+
+		histogram_insert_data_point(lag_hist, (now_us - start_us) * 1000);
+		queue_push(qs[n_reqs % num_queues], &req);
+
+		n_reqs++;
+		now_us = get_us();
+	}
+
+	// An "empty" request tells each drain thread to stop.
+	trans_req stop = { 0 };
+
+	for (uint32_t i = 0; i < num_queues; i++) {
+		queue_push(qs[i], &stop);
+		pthread_join(tids[i], NULL);
+		queue_destroy(qs[i]);
+	}
+
+	free(lag_hist);
+
+	return (double)n_reqs * 1000000.0 / (double)(now_us - start_us);
+}
+
 static bool
 check_configuration()
 {
@@ -255,8 +563,68 @@ check_configuration()
 		return false;
 	}
 
-	if (g_scfg.service_threads == 0) {
-		configuration_error(TAG_SERVICE_THREADS);
+	if (g_scfg.num_roles != 0 && g_scfg.num_roles != g_scfg.num_devices) {
+		configuration_error(TAG_DEVICE_ROLES);
+		return false;
+	}
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		if (g_scfg.device_roles[d] != DEVICE_ROLE_INDEX) {
+			g_scfg.num_data_devices++;
+		}
+
+		if (g_scfg.device_roles[d] != DEVICE_ROLE_DATA) {
+			g_scfg.num_index_devices++;
+		}
+	}
+
+	// Need somewhere for the records - and pmem mode is data only.
+	if (g_scfg.num_data_devices == 0 ||
+			(g_scfg.pmem && g_scfg.num_index_devices != 0)) {
+		configuration_error(TAG_DEVICE_ROLES);
+		return false;
+	}
+
+	// Per-device overrides pair up with device names in order.
+	if (g_scfg.num_read_mults != 0 &&
+			g_scfg.num_read_mults != g_scfg.num_devices) {
+		configuration_error(TAG_DEVICE_READ_MULTIPLIERS);
+		return false;
+	}
+
+	if (g_scfg.num_write_mults != 0 &&
+			g_scfg.num_write_mults != g_scfg.num_devices) {
+		configuration_error(TAG_DEVICE_WRITE_MULTIPLIERS);
+		return false;
+	}
+
+	if (g_scfg.num_large_block_mults != 0 &&
+			g_scfg.num_large_block_mults != g_scfg.num_devices) {
+		configuration_error(TAG_DEVICE_LARGE_BLOCK_MULTIPLIERS);
+		return false;
+	}
+
+	if (g_scfg.num_device_record_bytes != 0 &&
+			g_scfg.num_device_record_bytes != g_scfg.num_devices) {
+		configuration_error(TAG_DEVICE_RECORD_BYTES);
+		return false;
+	}
+
+	for (uint32_t d = 0; d < g_scfg.num_device_record_bytes; d++) {
+		if (g_scfg.device_record_bytes[d] > g_scfg.large_block_ops_bytes) {
+			configuration_error(TAG_DEVICE_RECORD_BYTES);
+			return false;
+		}
+	}
+
+	g_scfg.per_device_rates = g_scfg.num_read_mults != 0 ||
+			g_scfg.num_write_mults != 0 || g_scfg.num_large_block_mults != 0 ||
+			g_scfg.num_device_record_bytes != 0;
+
+	// Shadow devices pair up with data devices in order.
+	if (g_scfg.num_shadows != 0 &&
+			g_scfg.num_shadows != g_scfg.num_data_devices) {
+		configuration_error(TAG_SHADOW_DEVICE_NAMES);
 		return false;
 	}
 
@@ -270,8 +638,29 @@ check_configuration()
 		return false;
 	}
 
-	if (g_scfg.run_us == 0) {
-		configuration_error(TAG_TEST_DURATION_SEC);
+	// Adaptive pool starts at threads-per-queue and may grow to the max.
+	if (g_scfg.threads_per_queue_max != 0 &&
+			g_scfg.threads_per_queue_max < g_scfg.threads_per_queue) {
+		configuration_error(TAG_THREADS_PER_QUEUE_MAX);
+		return false;
+	}
+
+	if (g_scfg.threads_per_queue_max != 0 &&
+			g_scfg.queue_wait_target_us == 0) {
+		configuration_error(TAG_QUEUE_WAIT_TARGET_USEC);
+		return false;
+	}
+
+	// Coroutines only yield on async IO - pmem mode has none, and buffered
+	// file IO completes inside io_submit(), blocking all the coroutines.
+	if (g_scfg.coroutines_per_thread != 0 && (g_scfg.pmem ||
+			(g_scfg.file_size != 0 && ! g_scfg.file_direct_io))) {
+		configuration_error(TAG_COROUTINES_PER_THREAD);
+		return false;
+	}
+
+	if (g_scfg.num_index_devices != 0 && g_scfg.cache_threads == 0) {
+		configuration_error(TAG_CACHE_THREADS);
 		return false;
 	}
 
@@ -280,6 +669,22 @@ check_configuration()
 		return false;
 	}
 
+	if (g_scfg.num_load_steps != 0) {
+		if (g_scfg.load_step_us == 0 ||
+				g_scfg.load_step_us % g_scfg.report_interval_us != 0) {
+			configuration_error(TAG_LOAD_STEP_SEC);
+			return false;
+		}
+
+		// A load sweep runs for exactly its steps.
+		g_scfg.run_us = g_scfg.num_load_steps * g_scfg.load_step_us;
+	}
+
+	if (g_scfg.run_us == 0) {
+		configuration_error(TAG_TEST_DURATION_SEC);
+		return false;
+	}
+
 	if (g_scfg.record_bytes == 0) {
 		configuration_error(TAG_RECORD_BYTES);
 		return false;
@@ -291,6 +696,16 @@ check_configuration()
 		return false;
 	}
 
+	if (g_scfg.recent_read_pct > 100) {
+		configuration_error(TAG_RECENT_READ_PCT);
+		return false;
+	}
+
+	if (g_scfg.recent_read_pct != 0 && g_scfg.recent_ring_size == 0) {
+		configuration_error(TAG_RECENT_RING_SIZE);
+		return false;
+	}
+
 	if (g_scfg.large_block_ops_bytes < g_scfg.record_bytes ||
 			g_scfg.large_block_ops_bytes < g_scfg.record_bytes_rmx ||
 			! is_power_of_2(g_scfg.large_block_ops_bytes)) {
@@ -298,6 +713,34 @@ check_configuration()
 		return false;
 	}
 
+	if (g_scfg.large_block_threads == 0) {
+		configuration_error(TAG_LARGE_BLOCK_THREADS);
+		return false;
+	}
+
+	if (g_scfg.large_block_chunk_bytes != 0 &&
+			(g_scfg.large_block_chunk_bytes > g_scfg.large_block_ops_bytes ||
+					! is_power_of_2(g_scfg.large_block_chunk_bytes))) {
+		configuration_error(TAG_LARGE_BLOCK_CHUNK_KBYTES);
+		return false;
+	}
+
+	// Async IO needs fds - pmem mode has none.
+	if (g_scfg.large_block_chunk_bytes != 0 && g_scfg.pmem &&
+			g_scfg.large_block_chunk_mode == CHUNK_MODE_PARALLEL) {
+		configuration_error(TAG_LARGE_BLOCK_CHUNK_MODE);
+		return false;
+	}
+
+	// Buffered async IO completes inside io_submit(), one chunk after
+	// another, so every chunk would show about the whole block's latency.
+	if (g_scfg.large_block_chunk_bytes != 0 && g_scfg.file_size != 0 &&
+			! g_scfg.file_direct_io &&
+			g_scfg.large_block_chunk_mode == CHUNK_MODE_PARALLEL) {
+		configuration_error(TAG_LARGE_BLOCK_CHUNK_MODE);
+		return false;
+	}
+
 	if (g_scfg.replication_factor == 0) {
 		configuration_error(TAG_REPLICATION_FACTOR);
 		return false;
@@ -318,6 +761,11 @@ check_configuration()
 		return false;
 	}
 
+	if (g_scfg.max_shadow_writes_queued == 0) {
+		configuration_error(TAG_MAX_SHADOW_WRITES_QUEUED);
+		return false;
+	}
+
 	if (g_scfg.commit_min_bytes != 0 &&
 			(g_scfg.commit_min_bytes > g_scfg.large_block_ops_bytes ||
 			! is_power_of_2(g_scfg.commit_min_bytes))) {
@@ -337,9 +785,19 @@ derive_configuration()
 		return false;
 	}
 
+	// Per-device multipliers scale each stream's total by their mean.
+	double read_mult = derive_device_shares(g_scfg.device_read_mults,
+			g_scfg.num_read_mults, g_scfg.device_read_shares);
+	double write_mult = derive_device_shares(g_scfg.device_write_mults,
+			g_scfg.num_write_mults, g_scfg.device_write_shares);
+	double large_block_mult = derive_device_shares(
+			g_scfg.device_large_block_mults, g_scfg.num_large_block_mults,
+			g_scfg.device_large_block_shares);
+
 	// Non-zero update-pct causes client writes to generate internal reads.
-	g_scfg.internal_read_reqs_per_sec = g_scfg.read_reqs_per_sec +
-			(g_scfg.write_reqs_per_sec * g_scfg.update_pct / 100);
+	g_scfg.internal_read_reqs_per_sec = (uint64_t)(read_mult *
+			(g_scfg.read_reqs_per_sec +
+					(g_scfg.write_reqs_per_sec * g_scfg.update_pct / 100)));
 
 	// 'replication-factor' > 1 causes replica writes (which are replaces).
 	uint32_t internal_write_reqs_per_sec =
@@ -351,6 +809,18 @@ derive_configuration()
 			g_scfg.record_stored_bytes :
 			round_up_to_rblock(g_scfg.record_bytes_rmx);
 
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		uint32_t record_bytes = d < g_scfg.num_device_record_bytes ?
+				g_scfg.device_record_bytes[d] : 0;
+
+		// An override means fixed-size records on that device.
+		g_scfg.device_record_stored_bytes[d] = record_bytes == 0 ?
+				g_scfg.record_stored_bytes : round_up_to_rblock(record_bytes);
+		g_scfg.device_record_stored_bytes_rmx[d] = record_bytes == 0 ?
+				g_scfg.record_stored_bytes_rmx :
+				g_scfg.device_record_stored_bytes[d];
+	}
+
 	// Assumes linear probability distribution across size range.
 	uint32_t avg_record_stored_bytes =
 			(g_scfg.record_stored_bytes + g_scfg.record_stored_bytes_rmx) / 2;
@@ -370,17 +840,32 @@ derive_configuration()
 	// Large block read rate always matches overall write rate.
 	g_scfg.large_block_reads_per_sec =
 			original_write_rate_in_large_blocks_per_sec *
-			defrag_write_amplification;
+			defrag_write_amplification * large_block_mult;
+
+	// Zero 'service-threads' means calibrate, then pick enough.
+	if (g_scfg.service_threads == 0) {
+		uint64_t generated_reqs_per_sec = g_scfg.internal_read_reqs_per_sec;
+
+		if (g_scfg.commit_to_device) {
+			generated_reqs_per_sec +=
+					(uint64_t)(internal_write_reqs_per_sec * write_mult);
+		}
+
+		if (! derive_service_threads(generated_reqs_per_sec)) {
+			return false;
+		}
+	}
 
 	if (g_scfg.commit_to_device) {
 		// In 'commit-to-device' mode, only write rate caused by defrag is done
 		// via large block writes.
 		g_scfg.large_block_writes_per_sec =
 				original_write_rate_in_large_blocks_per_sec *
-				(defrag_write_amplification - 1.0);
+				(defrag_write_amplification - 1.0) * large_block_mult;
 
 		// "Original" writes are done individually.
-		g_scfg.internal_write_reqs_per_sec = internal_write_reqs_per_sec;
+		g_scfg.internal_write_reqs_per_sec =
+				(uint64_t)(internal_write_reqs_per_sec * write_mult);
 
 		// Share the service threads between read and write request generators.
 		uint64_t total_reqs_per_sec =
@@ -421,6 +906,13 @@ derive_configuration()
 		g_scfg.write_req_threads = 0;
 	}
 
+	// Index devices see act_index's cache thread load - a 4K read and write
+	// per (replica) write, amplified by defrag.
+	if (g_scfg.num_index_devices != 0) {
+		g_scfg.index_cache_ops_per_sec = internal_write_reqs_per_sec *
+				defrag_write_amplification;
+	}
+
 	// Non-zero read load must be enough to calculate thread rates safely.
 	if (g_scfg.read_reqs_per_sec != 0 &&
 			g_scfg.internal_read_reqs_per_sec / g_scfg.read_req_threads == 0) {
@@ -432,6 +924,58 @@ derive_configuration()
 	return true;
 }
 
+// Turn per-device multipliers into each data device's share of a stream, and
+// return the mean multiplier - how much the stream's total is scaled by.
+static double
+derive_device_shares(const double mults[], uint32_t num_mults, double shares[])
+{
+	double sum = 0.0;
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		bool is_data = g_scfg.device_roles[d] != DEVICE_ROLE_INDEX;
+
+		shares[d] = ! is_data ? 0.0 : num_mults == 0 ? 1.0 : mults[d];
+		sum += shares[d];
+	}
+
+	for (uint32_t d = 0; d < g_scfg.num_devices; d++) {
+		shares[d] /= sum;
+	}
+
+	return sum / g_scfg.num_data_devices;
+}
+
+// Pick enough service threads for the peak request rate, with headroom, from a
+// calibrated rate per thread.
+static bool
+derive_service_threads(uint64_t total_reqs_per_sec)
+{
+	double max_load_mult = 1.0;
+
+	for (uint32_t i = 0; i < g_scfg.num_load_steps; i++) {
+		if (g_scfg.load_multipliers[i] > max_load_mult) {
+			max_load_mult = g_scfg.load_multipliers[i];
+		}
+	}
+
+	g_scfg.generator_reqs_per_sec = calibrate_generator_reqs_per_sec();
+
+	if (g_scfg.generator_reqs_per_sec == 0.0) {
+		configuration_error(TAG_SERVICE_THREADS);
+		return false;
+	}
+
+	g_scfg.service_threads = (uint32_t)ceil(
+			(double)total_reqs_per_sec * max_load_mult /
+			(g_scfg.generator_reqs_per_sec * GENERATOR_HEADROOM));
+
+	if (g_scfg.service_threads == 0) {
+		g_scfg.service_threads = 1;
+	}
+
+	return true;
+}
+
 static void
 echo_configuration()
 {
@@ -446,23 +990,96 @@ echo_configuration()
 	fprintf(stdout, "\nnum-devices: %" PRIu32 "\n",
 			g_scfg.num_devices);
 
+	fprintf(stdout, "%s:", TAG_DEVICE_ROLES);
+
+	for (int d = 0; d < g_scfg.num_devices; d++) {
+		fprintf(stdout, " %s", DEVICE_ROLES[g_scfg.device_roles[d]]);
+	}
+
+	fprintf(stdout, "\n");
+
+	fprintf(stdout, "%s:", TAG_SHADOW_DEVICE_NAMES);
+
+	for (int d = 0; d < g_scfg.num_shadows; d++) {
+		fprintf(stdout, " %s", g_scfg.shadow_names[d]);
+	}
+
+	fprintf(stdout, "\n");
+
+	if (g_scfg.per_device_rates) {
+		fprintf(stdout, "%s:", TAG_DEVICE_READ_MULTIPLIERS);
+
+		for (uint32_t d = 0; d < g_scfg.num_read_mults; d++) {
+			fprintf(stdout, " %g", g_scfg.device_read_mults[d]);
+		}
+
+		fprintf(stdout, "\n%s:", TAG_DEVICE_WRITE_MULTIPLIERS);
+
+		for (uint32_t d = 0; d < g_scfg.num_write_mults; d++) {
+			fprintf(stdout, " %g", g_scfg.device_write_mults[d]);
+		}
+
+		fprintf(stdout, "\n%s:", TAG_DEVICE_LARGE_BLOCK_MULTIPLIERS);
+
+		for (uint32_t d = 0; d < g_scfg.num_large_block_mults; d++) {
+			fprintf(stdout, " %g", g_scfg.device_large_block_mults[d]);
+		}
+
+		fprintf(stdout, "\n%s:", TAG_DEVICE_RECORD_BYTES);
+
+		for (uint32_t d = 0; d < g_scfg.num_device_record_bytes; d++) {
+			fprintf(stdout, " %" PRIu32, g_scfg.device_record_bytes[d]);
+		}
+
+		fprintf(stdout, "\n");
+	}
+
 	if (g_scfg.file_size != 0) { // undocumented - don't always expose
 		fprintf(stdout, "%s: %" PRIu64 "\n", TAG_FILE_SIZE_MBYTES,
 				g_scfg.file_size >> 20);
+		fprintf(stdout, "%s: %s\n", TAG_FILE_DIRECT_IO,
+				g_scfg.file_direct_io ? "yes" : "no");
+		fprintf(stdout, "%s: %s\n", TAG_FILE_FADVISE,
+				fadvise_name(g_scfg.file_fadvise));
+		fprintf(stdout, "%s: %s\n", TAG_FILE_SYNC_RANGE,
+				SYNC_RANGE_MODES[g_scfg.file_sync_range]);
+		fprintf(stdout, "%s: %s\n", TAG_FILE_DROP_CACHE,
+				g_scfg.file_drop_cache ? "yes" : "no");
 	}
 
-	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_SERVICE_THREADS,
-			g_scfg.service_threads);
+	fprintf(stdout, "%s: %s\n", TAG_PMEM, g_scfg.pmem ? "yes" : "no");
+	fprintf(stdout, "%s: %s\n", TAG_PMEM_PERSIST,
+			PMEM_PERSIST_MODES[g_scfg.pmem_persist]);
+
+	fprintf(stdout, "%s: %" PRIu32 "%s\n", TAG_SERVICE_THREADS,
+			g_scfg.service_threads,
+			g_scfg.generator_reqs_per_sec != 0.0 ? " (auto)" : "");
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_NUM_QUEUES,
 			g_scfg.num_queues);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_THREADS_PER_QUEUE,
 			g_scfg.threads_per_queue);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_THREADS_PER_QUEUE_MAX,
+			g_scfg.threads_per_queue_max);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_QUEUE_WAIT_TARGET_USEC,
+			g_scfg.queue_wait_target_us);
+	fprintf(stdout, "%s: %s\n", TAG_WORK_STEALING,
+			g_scfg.work_stealing ? "yes" : "no");
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_COROUTINES_PER_THREAD,
+			g_scfg.coroutines_per_thread);
+	fprintf(stdout, "%s: %s\n", TAG_QUEUE_PARK,
+			QUEUE_PARK_MODES[g_scfg.queue_park]);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_QUEUE_SPIN_USEC,
+			g_scfg.queue_spin_us);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_CACHE_THREADS,
+			g_scfg.cache_threads);
 	fprintf(stdout, "%s: %" PRIu64 "\n", TAG_TEST_DURATION_SEC,
 			g_scfg.run_us / 1000000);
 	fprintf(stdout, "%s: %" PRIu64 "\n", TAG_REPORT_INTERVAL_SEC,
 			g_scfg.report_interval_us / 1000000);
 	fprintf(stdout, "%s: %s\n", TAG_MICROSECOND_HISTOGRAMS,
 			g_scfg.us_histograms ? "yes" : "no");
+	fprintf(stdout, "%s: %s\n", TAG_PERF_COUNTERS,
+			g_scfg.perf_counters ? "yes" : "no");
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_READ_REQS_PER_SEC,
 			g_scfg.read_reqs_per_sec);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_WRITE_REQS_PER_SEC,
@@ -471,8 +1088,22 @@ echo_configuration()
 			g_scfg.record_bytes);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_RECORD_BYTES_RANGE_MAX,
 			g_scfg.record_bytes_rmx);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_RECENT_READ_PCT,
+			g_scfg.recent_read_pct);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_RECENT_READ_HALF_LIFE,
+			g_scfg.recent_read_half_life);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_RECENT_RING_SIZE,
+			g_scfg.recent_ring_size);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_LARGE_BLOCK_OP_KBYTES,
 			g_scfg.large_block_ops_bytes / 1024);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_LARGE_BLOCK_THREADS,
+			g_scfg.large_block_threads);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_LARGE_BLOCK_CHUNK_KBYTES,
+			g_scfg.large_block_chunk_bytes / 1024);
+	fprintf(stdout, "%s: %s\n", TAG_LARGE_BLOCK_CHUNK_MODE,
+			CHUNK_MODES[g_scfg.large_block_chunk_mode]);
+	fprintf(stdout, "%s: %" PRIu64 "\n", TAG_FLUSH_MAX_MS,
+			g_scfg.flush_max_us / 1000);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_REPLICATION_FACTOR,
 			g_scfg.replication_factor);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_UPDATE_PCT,
@@ -491,11 +1122,35 @@ echo_configuration()
 			g_scfg.tomb_raider_sleep_us);
 	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_MAX_REQS_QUEUED,
 			g_scfg.max_reqs_queued);
+	fprintf(stdout, "%s: %" PRIu32 "\n", TAG_MAX_SHADOW_WRITES_QUEUED,
+			g_scfg.max_shadow_writes_queued);
 	fprintf(stdout, "%s: %" PRIu64 "\n", TAG_MAX_LAG_SEC,
 			g_scfg.max_lag_usec / 1000000);
+	fprintf(stdout, "%s: %s\n", TAG_ON_OVERLOAD,
+			OVERLOAD_MODES[g_scfg.on_overload]);
 	fprintf(stdout, "%s: %s\n", TAG_SCHEDULER_MODE,
 			g_scfg.scheduler_mode);
 
+	char ioprio[IOPRIO_NAME_SIZE];
+
+	ioprio_name(g_scfg.transaction_ioprio, ioprio);
+	fprintf(stdout, "%s: %s\n", TAG_TRANSACTION_IOPRIO, ioprio);
+	ioprio_name(g_scfg.large_block_ioprio, ioprio);
+	fprintf(stdout, "%s: %s\n", TAG_LARGE_BLOCK_IOPRIO, ioprio);
+	ioprio_name(g_scfg.tomb_raider_ioprio, ioprio);
+	fprintf(stdout, "%s: %s\n", TAG_TOMB_RAIDER_IOPRIO, ioprio);
+	ioprio_name(g_scfg.cache_ioprio, ioprio);
+	fprintf(stdout, "%s: %s\n", TAG_CACHE_IOPRIO, ioprio);
+
+	fprintf(stdout, "%s:", TAG_LOAD_MULTIPLIERS);
+
+	for (uint32_t i = 0; i < g_scfg.num_load_steps; i++) {
+		fprintf(stdout, " %g", g_scfg.load_multipliers[i]);
+	}
+
+	fprintf(stdout, "\n%s: %" PRIu64 "\n", TAG_LOAD_STEP_SEC,
+			g_scfg.load_step_us / 1000000);
+
 	fprintf(stdout, "\nDERIVED CONFIGURATION\n");
 
 	fprintf(stdout, "record-stored-bytes: %" PRIu32 " ... %" PRIu32 "\n",
@@ -508,10 +1163,194 @@ echo_configuration()
 			g_scfg.read_req_threads);
 	fprintf(stdout, "write-req-threads: %" PRIu32 "\n",
 			g_scfg.write_req_threads);
+
+	if (g_scfg.generator_reqs_per_sec != 0.0) {
+		fprintf(stdout, "calibrated-reqs-per-sec-per-service-thread: %.0lf\n",
+				g_scfg.generator_reqs_per_sec);
+	}
+
 	fprintf(stdout, "large-block-reads-per-sec: %.2lf\n",
 			g_scfg.large_block_reads_per_sec);
 	fprintf(stdout, "large-block-writes-per-sec: %.2lf\n",
 			g_scfg.large_block_writes_per_sec);
+	fprintf(stdout, "num-data-devices: %" PRIu32 "\n",
+			g_scfg.num_data_devices);
+	fprintf(stdout, "num-index-devices: %" PRIu32 "\n",
+			g_scfg.num_index_devices);
+
+	if (g_scfg.num_index_devices != 0) {
+		fprintf(stdout, "index-cache-ops-per-sec: %.2lf\n",
+				g_scfg.index_cache_ops_per_sec);
+	}
 
 	fprintf(stdout, "\n");
 }
+
+static const char*
+fadvise_name(int advice)
+{
+	for (uint32_t m = 0; m < N_FADVISE_MODES; m++) {
+		if (FADVISE_MODES[m].advice == advice) {
+			return FADVISE_MODES[m].name;
+		}
+	}
+
+	return "none";
+}
+
+static chunk_mode
+parse_chunk_mode()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing chunk mode - using 'parallel'\n");
+		return CHUNK_MODE_PARALLEL;
+	}
+
+	for (uint32_t m = 0; m < N_CHUNK_MODES; m++) {
+		if (strcmp(val, CHUNK_MODES[m]) == 0) {
+			return (chunk_mode)m;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown chunk mode '%s' - using 'parallel'\n",
+			val);
+
+	return CHUNK_MODE_PARALLEL;
+}
+
+static void
+parse_device_roles()
+{
+	const char* val;
+
+	while ((val = strtok(NULL, ",;" WHITE_SPACE)) != NULL) {
+		if (g_scfg.num_roles == MAX_NUM_STORAGE_DEVICES) {
+			fprintf(stdout, "ERROR: too many device roles\n");
+			g_scfg.num_roles = 0;
+			return;
+		}
+
+		uint32_t m;
+
+		for (m = 0; m < N_DEVICE_ROLES; m++) {
+			if (strcmp(val, DEVICE_ROLES[m]) == 0) {
+				break;
+			}
+		}
+
+		if (m == N_DEVICE_ROLES) {
+			fprintf(stdout, "ERROR: unknown device role '%s' - using 'data'\n",
+					val);
+			m = DEVICE_ROLE_DATA;
+		}
+
+		g_scfg.device_roles[g_scfg.num_roles++] = (device_role)m;
+	}
+}
+
+static int
+parse_fadvise()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing fadvise mode - using 'none'\n");
+		return -1;
+	}
+
+	for (uint32_t m = 0; m < N_FADVISE_MODES; m++) {
+		if (strcmp(val, FADVISE_MODES[m].name) == 0) {
+			return FADVISE_MODES[m].advice;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown fadvise mode '%s' - using 'none'\n", val);
+
+	return -1;
+}
+
+static pmem_persist_mode
+parse_pmem_persist_mode()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing pmem persist mode - using 'nt'\n");
+		return PMEM_PERSIST_NT;
+	}
+
+	for (uint32_t m = 0; m < N_PMEM_PERSIST_MODES; m++) {
+		if (strcmp(val, PMEM_PERSIST_MODES[m]) == 0) {
+			return (pmem_persist_mode)m;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown pmem persist mode '%s' - using 'nt'\n",
+			val);
+
+	return PMEM_PERSIST_NT;
+}
+
+static queue_park_mode
+parse_queue_park_mode()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing queue park mode - using 'condvar'\n");
+		return QUEUE_PARK_CONDVAR;
+	}
+
+	for (uint32_t m = 0; m < N_QUEUE_PARK_MODES; m++) {
+		if (strcmp(val, QUEUE_PARK_MODES[m]) == 0) {
+			return (queue_park_mode)m;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown queue park mode '%s' - using 'condvar'\n",
+			val);
+
+	return QUEUE_PARK_CONDVAR;
+}
+
+static sync_range_mode
+parse_sync_range_mode()
+{
+	const char* val = strtok(NULL, WHITE_SPACE);
+
+	if (! val) {
+		fprintf(stdout, "ERROR: missing sync range mode - using 'none'\n");
+		return SYNC_RANGE_NONE;
+	}
+
+	for (uint32_t m = 0; m < N_SYNC_RANGE_MODES; m++) {
+		if (strcmp(val, SYNC_RANGE_MODES[m]) == 0) {
+			return (sync_range_mode)m;
+		}
+	}
+
+	fprintf(stdout, "ERROR: unknown sync range mode '%s' - using 'none'\n",
+			val);
+
+	return SYNC_RANGE_NONE;
+}
+
+// Runs in calibration threads, popping requests like a transaction thread
+// would, until it pops an empty one.
+static void*
+run_calibration_drain(void* pv_q)
+{
+	queue* q = (queue*)pv_q;
+	trans_req req;
+
+	while (true) {
+		if (queue_pop(q, (void*)&req, QUEUE_FOREVER) == QUEUE_OK &&
+				req.start_time == 0) {
+			break;
+		}
+	}
+
+	return NULL;
+}
@@ -32,6 +32,8 @@
 #include <stdint.h>
 
 #include "common/cfg.h"
+#include "common/pmem.h"
+#include "common/queue.h"
 
 
 //==========================================================
@@ -39,22 +41,89 @@
 //
 
 #define MAX_NUM_STORAGE_DEVICES 128
+#define MAX_NUM_LOAD_STEPS 64
+
+// What a device is used for - see 'device-roles'.
+typedef enum {
+	DEVICE_ROLE_DATA,   // records & large blocks (default)
+	DEVICE_ROLE_INDEX,  // 4K index reads & writes, as in act_index
+	DEVICE_ROLE_BOTH
+} device_role;
+
+// How (buffered) file mode writes are written back - see 'file-sync-range'.
+typedef enum {
+	SYNC_RANGE_NONE,    // leave it to the kernel (default)
+	SYNC_RANGE_START,   // start writeback of each write
+	SYNC_RANGE_WAIT     // complete writeback of each write
+} sync_range_mode;
+
+// How large-block ops are split - see 'large-block-chunk-mode'.
+typedef enum {
+	CHUNK_MODE_PARALLEL,    // submit all chunks at once (default)
+	CHUNK_MODE_SEQUENTIAL   // submit each chunk after the last completes
+} chunk_mode;
+
+// A transaction request, as request generators queue them for transaction
+// threads. Shared so 'service-threads' calibration queues the real thing.
+struct device_s;
+
+typedef struct trans_req_s {
+	struct device_s* dev;
+	uint64_t offset;
+	uint32_t size;
+	bool is_write;
+	bool is_recent;                 // see 'recent-read-pct'
+	uint64_t start_time;
+} trans_req;
 
 typedef struct storage_cfg_s {
 	char device_names[MAX_NUM_STORAGE_DEVICES][MAX_DEVICE_NAME_SIZE];
 	uint32_t num_devices;           // derived by counting device names
+	device_role device_roles[MAX_NUM_STORAGE_DEVICES];
+	uint32_t num_roles;             // derived by counting device roles
+	char shadow_names[MAX_NUM_STORAGE_DEVICES][MAX_DEVICE_NAME_SIZE];
+	uint32_t num_shadows;           // derived by counting shadow names
+	double device_read_mults[MAX_NUM_STORAGE_DEVICES];
+	uint32_t num_read_mults;        // derived by counting multipliers
+	double device_write_mults[MAX_NUM_STORAGE_DEVICES];
+	uint32_t num_write_mults;       // derived by counting multipliers
+	double device_large_block_mults[MAX_NUM_STORAGE_DEVICES];
+	uint32_t num_large_block_mults; // derived by counting multipliers
+	uint32_t device_record_bytes[MAX_NUM_STORAGE_DEVICES]; // 0 - use global
+	uint32_t num_device_record_bytes; // derived by counting record sizes
 	uint64_t file_size;             // undocumented feature - use files
+	bool file_direct_io;            // undocumented - file mode only
+	int file_fadvise;               // undocumented - POSIX_FADV_*, or -1
+	sync_range_mode file_sync_range; // undocumented - file mode only
+	bool file_drop_cache;           // undocumented - file mode only
+	bool pmem;
+	pmem_persist_mode pmem_persist;
 	uint32_t service_threads;
 	uint32_t num_queues;
 	uint32_t threads_per_queue;
+	uint32_t threads_per_queue_max;
+	uint32_t queue_wait_target_us;
+	bool work_stealing;
+	uint32_t coroutines_per_thread;
+	queue_park_mode queue_park;
+	uint32_t queue_spin_us;
+	uint32_t cache_threads;
 	uint64_t run_us;                // converted from literal units in seconds
 	uint64_t report_interval_us;    // converted from literal units in seconds
 	bool us_histograms;
+	bool perf_counters;
 	uint32_t read_reqs_per_sec;
 	uint32_t write_reqs_per_sec;
 	uint32_t record_bytes;
 	uint32_t record_bytes_rmx;
+	uint32_t recent_read_pct;
+	uint32_t recent_read_half_life; // in large-block writes
+	uint32_t recent_ring_size;      // per device, in large-block writes
 	uint32_t large_block_ops_bytes; // converted from literal units in Kbytes
+	uint32_t large_block_threads;   // per device, per direction
+	uint32_t large_block_chunk_bytes; // converted from literal units in Kbytes
+	chunk_mode large_block_chunk_mode;
+	uint64_t flush_max_us;          // converted from literal units in ms
 	uint32_t replication_factor;
 	uint32_t update_pct;
 	uint32_t defrag_lwm_pct;
@@ -64,16 +133,35 @@ typedef struct storage_cfg_s {
 	bool tomb_raider;
 	uint32_t tomb_raider_sleep_us;
 	uint32_t max_reqs_queued;
+	uint32_t max_shadow_writes_queued;
 	uint64_t max_lag_usec;          // converted from literal units in seconds
+	overload_mode on_overload;
 	const char* scheduler_mode;
+	int transaction_ioprio;         // ioprio_set() values
+	int large_block_ioprio;
+	int tomb_raider_ioprio;
+	int cache_ioprio;
+	double load_multipliers[MAX_NUM_LOAD_STEPS];
+	uint32_t num_load_steps;        // derived by counting load multipliers
+	uint64_t load_step_us;          // converted from literal units in seconds
 
 	// Derived from literal configuration:
+	uint32_t num_data_devices;
+	uint32_t num_index_devices;
+	bool per_device_rates;          // any per-device override configured
+	double device_read_shares[MAX_NUM_STORAGE_DEVICES];
+	double device_write_shares[MAX_NUM_STORAGE_DEVICES];
+	double device_large_block_shares[MAX_NUM_STORAGE_DEVICES];
+	uint32_t device_record_stored_bytes[MAX_NUM_STORAGE_DEVICES];
+	uint32_t device_record_stored_bytes_rmx[MAX_NUM_STORAGE_DEVICES];
+	double index_cache_ops_per_sec;
 	uint32_t record_stored_bytes;
 	uint32_t record_stored_bytes_rmx;
 	uint64_t internal_read_reqs_per_sec;
 	uint64_t internal_write_reqs_per_sec;
 	uint32_t read_req_threads;
 	uint32_t write_req_threads;
+	double generator_reqs_per_sec;  // only if service-threads calibrated
 	double large_block_reads_per_sec;
 	double large_block_writes_per_sec;
 } storage_cfg;